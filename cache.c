@@ -0,0 +1,336 @@
+#include "filesys/cache.h"
+#include <debug.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "filesys/filesys.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+/* Buffer cache for the file system device.
+
+   Holds CACHE_SIZE sectors, chosen for eviction by the clock
+   algorithm.  Writes only modify the cached copy; a write-behind
+   thread writes dirty sectors back every CACHE_FLUSH_TICKS timer
+   ticks, and cache_flush() writes them all back on demand, which
+   filesys_done() must do at shutdown.  When sectors are read in
+   order, a read-ahead thread fetches the following sector in the
+   background, so a sequential reader finds it already cached.
+
+   `cache_lock' protects which sector each entry holds, the pin
+   counts and the clock hand.  Each entry also has its own lock,
+   held while its data is read, written, loaded or written back,
+   so I/O on one sector does not hold up the rest of the cache.
+   A pinned entry keeps its sector, so its lock may be acquired
+   after `cache_lock' is released.  An entry only ever changes
+   sector while it is clean, so the disk copy of a sector that is
+   not cached is always current. */
+struct cache_entry
+  {
+    block_sector_t sector;      /* Sector held, if VALID or pinned. */
+    bool valid;                 /* Holds SECTOR's contents? */
+    bool dirty;                 /* Differs from the disk? */
+    bool accessed;              /* Used since the clock hand passed? */
+    int pins;                   /* Threads using or waiting on it. */
+    struct lock lock;           /* Serializes access to DATA. */
+    uint8_t data[BLOCK_SECTOR_SIZE];
+  };
+
+static struct cache_entry cache[CACHE_SIZE];
+static struct lock cache_lock;
+static size_t clock_hand;
+
+/* Timer ticks between passes of the write-behind thread. */
+#define CACHE_FLUSH_TICKS (TIMER_FREQ * 5)
+
+/* Sectors waiting to be read ahead, in a small ring.  Requests
+   that find it full are dropped. */
+#define READ_AHEAD_SLOTS 16
+static block_sector_t read_ahead_ring[READ_AHEAD_SLOTS];
+static size_t read_ahead_head, read_ahead_tail;
+static struct lock read_ahead_lock;
+static struct condition read_ahead_cond;
+
+/* Last sector read, for detecting sequential access. */
+static block_sector_t last_read = (block_sector_t) -1;
+
+/* Statistics. */
+static long long hit_cnt, miss_cnt, read_ahead_cnt, write_back_cnt;
+
+static struct cache_entry *cache_get (block_sector_t, bool load,
+                                      bool count);
+static void cache_put (struct cache_entry *, bool dirty);
+static void write_back (struct cache_entry *);
+static void read_ahead_queue (block_sector_t);
+static thread_func write_behind_thread NO_RETURN;
+static thread_func read_ahead_thread NO_RETURN;
+
+/* Initializes the buffer cache and starts its threads. */
+void
+cache_init (void)
+{
+  size_t i;
+
+  lock_init (&cache_lock);
+  for (i = 0; i < CACHE_SIZE; i++)
+    lock_init (&cache[i].lock);
+  lock_init (&read_ahead_lock);
+  cond_init (&read_ahead_cond);
+  thread_create ("cache-flush", PRI_DEFAULT, write_behind_thread, NULL);
+  thread_create ("cache-ahead", PRI_DEFAULT, read_ahead_thread, NULL);
+}
+
+/* Reads SECTOR into BUFFER, which must have room for
+   BLOCK_SECTOR_SIZE bytes. */
+void
+cache_read (block_sector_t sector, void *buffer)
+{
+  cache_read_at (sector, buffer, 0, BLOCK_SECTOR_SIZE);
+}
+
+/* Reads SIZE bytes starting at byte OFS of SECTOR into BUFFER.
+   If SECTOR follows the sector read last, queues the next one to
+   be read ahead. */
+void
+cache_read_at (block_sector_t sector, void *buffer, size_t ofs, size_t size)
+{
+  struct cache_entry *e;
+
+  ASSERT (ofs + size <= BLOCK_SECTOR_SIZE);
+
+  e = cache_get (sector, true, true);
+  memcpy (buffer, e->data + ofs, size);
+  cache_put (e, false);
+
+  if (sector == last_read + 1)
+    read_ahead_queue (sector + 1);
+  last_read = sector;
+}
+
+/* Writes BLOCK_SECTOR_SIZE bytes from BUFFER to SECTOR.  The
+   sector's old contents are never read. */
+void
+cache_write (block_sector_t sector, const void *buffer)
+{
+  struct cache_entry *e = cache_get (sector, false, true);
+  memcpy (e->data, buffer, BLOCK_SECTOR_SIZE);
+  e->valid = true;
+  cache_put (e, true);
+}
+
+/* Writes SIZE bytes from BUFFER to SECTOR starting at byte
+   OFS. */
+void
+cache_write_at (block_sector_t sector, const void *buffer, size_t ofs,
+                size_t size)
+{
+  struct cache_entry *e;
+
+  ASSERT (ofs + size <= BLOCK_SECTOR_SIZE);
+
+  if (ofs == 0 && size == BLOCK_SECTOR_SIZE)
+    {
+      cache_write (sector, buffer);
+      return;
+    }
+  e = cache_get (sector, true, true);
+  memcpy (e->data + ofs, buffer, size);
+  cache_put (e, true);
+}
+
+/* Writes every dirty sector back to disk. */
+void
+cache_flush (void)
+{
+  size_t i;
+
+  for (i = 0; i < CACHE_SIZE; i++)
+    {
+      struct cache_entry *e = &cache[i];
+
+      lock_acquire (&cache_lock);
+      if (!e->valid || !e->dirty)
+        {
+          lock_release (&cache_lock);
+          continue;
+        }
+      e->pins++;
+      lock_release (&cache_lock);
+
+      lock_acquire (&e->lock);
+      write_back (e);
+      cache_put (e, false);
+    }
+}
+
+/* Prints buffer cache statistics. */
+void
+cache_print_stats (void)
+{
+  printf ("Cache: %lld hits, %lld misses, %lld read ahead, "
+          "%lld written back\n",
+          hit_cnt, miss_cnt, read_ahead_cnt, write_back_cnt);
+}
+
+/* Returns the cache entry for SECTOR, pinned and locked, loading
+   it from disk first if LOAD is true and it is not cached.  If
+   LOAD is false, a newly assigned entry's data is garbage and
+   the caller must fill all of it.  Counts a hit or miss if
+   COUNT. */
+static struct cache_entry *
+cache_get (block_sector_t sector, bool load, bool count)
+{
+  struct cache_entry *e;
+  size_t i;
+
+  lock_acquire (&cache_lock);
+  for (;;)
+    {
+      /* Already cached, or on its way in? */
+      for (i = 0; i < CACHE_SIZE; i++)
+        {
+          e = &cache[i];
+          if ((e->valid || e->pins > 0) && e->sector == sector)
+            {
+              e->pins++;
+              e->accessed = true;
+              if (count)
+                hit_cnt++;
+              lock_release (&cache_lock);
+              lock_acquire (&e->lock);
+              return e;
+            }
+        }
+
+      /* Find a victim with the clock algorithm, giving each
+         recently used entry a second chance.  Two sweeps always
+         find an unpinned entry unless every one is pinned, in
+         which case wait for one to be released. */
+      e = NULL;
+      for (i = 0; i < 2 * CACHE_SIZE && e == NULL; i++)
+        {
+          struct cache_entry *c = &cache[clock_hand];
+          clock_hand = (clock_hand + 1) % CACHE_SIZE;
+          if (c->pins > 0)
+            continue;
+          if (c->valid && c->accessed)
+            c->accessed = false;
+          else
+            e = c;
+        }
+      if (e == NULL)
+        {
+          lock_release (&cache_lock);
+          thread_yield ();
+          lock_acquire (&cache_lock);
+          continue;
+        }
+
+      /* A dirty victim must go back to disk before it changes
+         sector.  Do that without holding the cache lock, then
+         start over, since anything may have changed meanwhile. */
+      if (e->valid && e->dirty)
+        {
+          e->pins++;
+          lock_release (&cache_lock);
+          lock_acquire (&e->lock);
+          write_back (e);
+          cache_put (e, false);
+          lock_acquire (&cache_lock);
+          continue;
+        }
+      break;
+    }
+
+  /* Take over clean entry E for SECTOR.  No one holds its lock,
+     since it was not pinned. */
+  e->sector = sector;
+  e->valid = false;
+  e->dirty = false;
+  e->accessed = true;
+  e->pins = 1;
+  if (count)
+    miss_cnt++;
+  lock_acquire (&e->lock);
+  lock_release (&cache_lock);
+
+  if (load)
+    {
+      block_read (fs_device, sector, e->data);
+      e->valid = true;
+    }
+  return e;
+}
+
+/* Unlocks and unpins E, which cache_get() returned, marking it
+   dirty if DIRTY. */
+static void
+cache_put (struct cache_entry *e, bool dirty)
+{
+  if (dirty)
+    e->dirty = true;
+  lock_release (&e->lock);
+
+  lock_acquire (&cache_lock);
+  e->pins--;
+  lock_release (&cache_lock);
+}
+
+/* Writes E back to disk if it is dirty.  Caller must hold E's
+   lock. */
+static void
+write_back (struct cache_entry *e)
+{
+  if (e->valid && e->dirty)
+    {
+      block_write (fs_device, e->sector, e->data);
+      e->dirty = false;
+      write_back_cnt++;
+    }
+}
+
+/* Asks the read-ahead thread to bring SECTOR into the cache, if
+   it exists and there is room in the queue. */
+static void
+read_ahead_queue (block_sector_t sector)
+{
+  if (sector >= block_size (fs_device))
+    return;
+  lock_acquire (&read_ahead_lock);
+  if (read_ahead_head - read_ahead_tail < READ_AHEAD_SLOTS)
+    {
+      read_ahead_ring[read_ahead_head++ % READ_AHEAD_SLOTS] = sector;
+      cond_signal (&read_ahead_cond, &read_ahead_lock);
+    }
+  lock_release (&read_ahead_lock);
+}
+
+/* Brings queued sectors into the cache, forever. */
+static void
+read_ahead_thread (void *aux UNUSED)
+{
+  for (;;)
+    {
+      block_sector_t sector;
+
+      lock_acquire (&read_ahead_lock);
+      while (read_ahead_head == read_ahead_tail)
+        cond_wait (&read_ahead_cond, &read_ahead_lock);
+      sector = read_ahead_ring[read_ahead_tail++ % READ_AHEAD_SLOTS];
+      lock_release (&read_ahead_lock);
+
+      cache_put (cache_get (sector, true, false), false);
+      read_ahead_cnt++;
+    }
+}
+
+/* Writes dirty sectors back periodically, forever. */
+static void
+write_behind_thread (void *aux UNUSED)
+{
+  for (;;)
+    {
+      timer_sleep (CACHE_FLUSH_TICKS);
+      cache_flush ();
+    }
+}
@@ -0,0 +1,146 @@
+#include "devices/conout.h"
+#include <debug.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+/* Buffered console output for user processes.
+
+   Writing to the console with putbuf() keeps the writer busy
+   until the serial port has taken every byte, so a process that
+   prints a lot holds up everyone waiting for the console lock
+   and runs no faster than the line.  Instead, conout_write()
+   copies the output into a ring and returns.  A kernel thread
+   hands the ring's contents to putbuf(), and there the serial
+   driver's transmit queue, drained by the UART's transmit
+   interrupt, keeps the drainer asleep while the line is busy.
+
+   Each write of up to `atomic_size' bytes is copied into the ring
+   in one piece under `lock', so it reaches the console without
+   output from other writers in the middle.  A writer that finds
+   too little room waits for the drainer, which keeps a fast
+   producer from running arbitrarily far ahead of the line.
+
+   The drainer reads [tail, head) without the lock, which is safe
+   because writers only ever fill in beyond `head'. */
+static char ring[CONOUT_SIZE];
+static size_t head;             /* Total bytes ever written. */
+static size_t tail;             /* Total bytes ever drained. */
+static struct lock lock;        /* Protects `head' and `tail'. */
+static struct condition not_full;   /* Signaled when space frees. */
+static struct condition not_empty;  /* Signaled when data arrives. */
+static struct condition drained;    /* Signaled as `tail' advances. */
+
+/* Largest write kept in one piece.  Configurable through
+   conout_set_atomic(). */
+static size_t atomic_size = 512;
+
+static thread_func drain_thread NO_RETURN;
+
+/* Initializes the ring and starts the thread that drains it. */
+void
+conout_init (void)
+{
+  lock_init (&lock);
+  cond_init (&not_full);
+  cond_init (&not_empty);
+  cond_init (&drained);
+  thread_create ("conout", PRI_MAX, drain_thread, NULL);
+}
+
+/* Sets the largest write that conout_write() keeps in one piece
+   to SIZE bytes, at least 1 and at most CONOUT_ATOMIC_MAX. */
+void
+conout_set_atomic (size_t size)
+{
+  atomic_size = size < 1 ? 1 : size < CONOUT_ATOMIC_MAX ? size
+                                                        : CONOUT_ATOMIC_MAX;
+}
+
+/* Queues the SIZE bytes in BUFFER for output to the console.
+   Pieces of up to `atomic_size' bytes go into the ring whole.
+   Blocks while the ring lacks room. */
+void
+conout_write (const void *buffer, size_t size)
+{
+  const char *p = buffer;
+
+  while (size > 0)
+    {
+      size_t n = size < atomic_size ? size : atomic_size;
+      size_t ofs, first;
+
+      lock_acquire (&lock);
+      while (CONOUT_SIZE - (head - tail) < n)
+        cond_wait (&not_full, &lock);
+      ofs = head % CONOUT_SIZE;
+      first = CONOUT_SIZE - ofs < n ? CONOUT_SIZE - ofs : n;
+      memcpy (ring + ofs, p, first);
+      memcpy (ring, p + first, n - first);
+      head += n;
+      cond_signal (&not_empty, &lock);
+      lock_release (&lock);
+
+      p += n;
+      size -= n;
+    }
+}
+
+/* Waits until everything queued so far has been handed to the
+   console.  Kernel messages that must appear after a process's
+   own output, such as its exit status, call this first.  Output
+   queued after the call does not hold it up, so a process that
+   keeps writing cannot stall another's flush indefinitely. */
+void
+conout_flush (void)
+{
+  size_t target;
+
+  lock_acquire (&lock);
+  target = head;
+  while ((ptrdiff_t) (tail - target) < 0)
+    cond_wait (&drained, &lock);
+  lock_release (&lock);
+}
+
+/* Writes out whatever is left in the ring synchronously, without
+   locking or blocking, so that a process's last output is not
+   lost in a kernel panic.  Call only after console_panic(). */
+void
+conout_panic (void)
+{
+  while (tail != head)
+    {
+      size_t ofs = tail % CONOUT_SIZE;
+      size_t n = head - tail < CONOUT_SIZE - ofs ? head - tail
+                                                 : CONOUT_SIZE - ofs;
+      putbuf (ring + ofs, n);
+      tail += n;
+    }
+}
+
+/* Moves output from the ring to the console, one contiguous run
+   at a time. */
+static void
+drain_thread (void *aux UNUSED)
+{
+  lock_acquire (&lock);
+  for (;;)
+    {
+      size_t ofs, n;
+
+      while (head == tail)
+        cond_wait (&not_empty, &lock);
+      ofs = tail % CONOUT_SIZE;
+      n = head - tail < CONOUT_SIZE - ofs ? head - tail : CONOUT_SIZE - ofs;
+      lock_release (&lock);
+
+      putbuf (ring + ofs, n);
+
+      lock_acquire (&lock);
+      tail += n;
+      cond_broadcast (&not_full, &lock);
+      cond_broadcast (&drained, &lock);
+    }
+}
@@ -0,0 +1,18 @@
+#ifndef DEVICES_CONOUT_H
+#define DEVICES_CONOUT_H
+
+#include <stddef.h>
+
+/* Size of the console output ring, in bytes. */
+#define CONOUT_SIZE 8192
+
+/* Largest write that conout_write() keeps in one piece. */
+#define CONOUT_ATOMIC_MAX 4096
+
+void conout_init (void);
+void conout_set_atomic (size_t);
+void conout_write (const void *, size_t);
+void conout_flush (void);
+void conout_panic (void);
+
+#endif /* devices/conout.h */
@@ -0,0 +1,270 @@
+#include "userprog/fdtable.h"
+#include <bitmap.h>
+#include <debug.h>
+#include "filesys/file.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "userprog/syscall.h"
+
+#define FD_TABLE_INIT 16        /* Initial number of slots. */
+#define FD_TABLE_MAX 1024       /* Most slots a table may have. */
+#define FD_TABLE_GROWTHS 6      /* log2 (FD_TABLE_MAX / FD_TABLE_INIT). */
+
+/* A process's file descriptors.
+
+   Descriptors index `slots' directly, so finding the file behind
+   one is a bounds check and an array load.  `used' tracks which
+   descriptors are taken so that open() can hand out the lowest
+   free one, as POSIX requires.  Both grow by doubling, up to
+   FD_TABLE_MAX descriptors.
+
+   Each slot has its own lock, held for the duration of an
+   operation on that descriptor, so operations on different
+   descriptors never wait on each other here, and close() waits
+   for an operation in progress on the same descriptor.  Slots are
+   allocated once and never move, only the array of pointers to
+   them does.  Lookups read the array without taking the table
+   lock, even from threads other than the owner's, such as the
+   asynchronous I/O workers.  That is safe because growth
+   publishes the new array before the new size, and keeps each
+   array it replaces until the table is destroyed, so a lookup
+   always indexes a live array within its bounds. */
+struct fd_table
+  {
+    struct fd_slot **slots;     /* Indexed by descriptor. */
+    size_t size;                /* Number of slots. */
+    struct bitmap *used;        /* One bit per slot, true if taken. */
+    struct lock lock;           /* Serializes install, remove, growth. */
+    struct fd_slot **retired[FD_TABLE_GROWTHS]; /* Replaced arrays. */
+    int retired_cnt;            /* Number of arrays in `retired'. */
+  };
+
+/* One descriptor. */
+struct fd_slot
+  {
+    struct lock lock;           /* Held during operations on FILE. */
+    struct file *file;          /* Open file, or null if free. */
+  };
+
+
+/* Descriptors 0 and 1 are the console and never hold a file. */
+#define FD_FIRST 2
+
+static bool grow (struct fd_table *, size_t size);
+
+/* Returns a new, empty descriptor table, or a null pointer if
+   memory is short. */
+struct fd_table *
+fd_table_create (void)
+{
+  struct fd_table *t = malloc (sizeof *t);
+  if (t == NULL)
+    return NULL;
+  t->slots = NULL;
+  t->size = 0;
+  t->used = NULL;
+  lock_init (&t->lock);
+  t->retired_cnt = 0;
+  if (!grow (t, FD_TABLE_INIT))
+    {
+      fd_table_destroy (t);
+      return NULL;
+    }
+  bitmap_set_multiple (t->used, 0, FD_FIRST, true);
+  return t;
+}
+
+/* Returns a copy of table SRC for a child created by fork(),
+   with the same descriptors open on the same files at the same
+   positions, or a null pointer if memory is short.  The parent
+   must not be using SRC meanwhile. */
+struct fd_table *
+fd_table_fork (struct fd_table *src)
+{
+  struct fd_table *t = fd_table_create ();
+  size_t fd;
+
+  if (t == NULL || !grow (t, src->size))
+    goto fail;
+
+  lock_acquire (&filesys_lock);
+  for (fd = FD_FIRST; fd < src->size; fd++)
+    {
+      struct file *file = src->slots[fd]->file;
+      if (file == NULL)
+        continue;
+      t->slots[fd]->file = file_reopen (file);
+      if (t->slots[fd]->file == NULL)
+        {
+          lock_release (&filesys_lock);
+          goto fail;
+        }
+      file_seek (t->slots[fd]->file, file_tell (file));
+      bitmap_mark (t->used, fd);
+    }
+  lock_release (&filesys_lock);
+  return t;
+
+ fail:
+  fd_table_destroy (t);
+  return NULL;
+}
+
+/* Closes every file open in table T and frees it.  The files are
+   closed in one pass under a single acquisition of the file
+   system lock.  T may be a null pointer. */
+void
+fd_table_destroy (struct fd_table *t)
+{
+  size_t fd;
+
+  if (t == NULL)
+    return;
+
+  lock_acquire (&filesys_lock);
+  for (fd = 0; fd < t->size; fd++)
+    if (t->slots[fd] != NULL)
+      file_close (t->slots[fd]->file);
+  lock_release (&filesys_lock);
+
+  for (fd = 0; fd < t->size; fd++)
+    free (t->slots[fd]);
+  free (t->slots);
+  while (t->retired_cnt > 0)
+    free (t->retired[--t->retired_cnt]);
+  if (t->used != NULL)
+    bitmap_destroy (t->used);
+  free (t);
+}
+
+/* Installs FILE in table T under the lowest free descriptor and
+   returns it, or returns -1 if the table is full or memory is
+   short.  On success T owns FILE. */
+int
+fd_install (struct fd_table *t, struct file *file)
+{
+  size_t fd;
+
+  ASSERT (file != NULL);
+
+  lock_acquire (&t->lock);
+  fd = bitmap_scan_and_flip (t->used, 0, 1, false);
+  if (fd == BITMAP_ERROR)
+    {
+      fd = t->size;
+      if (t->size >= FD_TABLE_MAX || !grow (t, t->size * 2))
+        {
+          lock_release (&t->lock);
+          return -1;
+        }
+      bitmap_mark (t->used, fd);
+    }
+  t->slots[fd]->file = file;
+  lock_release (&t->lock);
+  return fd;
+}
+
+/* Returns the file open under descriptor FD in table T, with
+   FD's slot locked, or a null pointer if FD is not open.  The
+   caller must pass a non-null return value to fd_release() when
+   done with it.  T may be a null pointer. */
+struct file *
+fd_acquire (struct fd_table *t, int fd)
+{
+  struct fd_slot *s;
+
+  if (t == NULL || fd < FD_FIRST || (size_t) fd >= t->size)
+    return NULL;
+  barrier ();
+  s = t->slots[fd];
+  lock_acquire (&s->lock);
+  if (s->file == NULL)
+    {
+      lock_release (&s->lock);
+      return NULL;
+    }
+  return s->file;
+}
+
+/* Unlocks descriptor FD in table T, which fd_acquire() locked. */
+void
+fd_release (struct fd_table *t, int fd)
+{
+  lock_release (&t->slots[fd]->lock);
+}
+
+/* Frees descriptor FD in table T and returns the file that was
+   open under it, which the caller must close, or returns a null
+   pointer if FD was not open.  Waits for any operation in
+   progress on FD to finish first. */
+struct file *
+fd_remove (struct fd_table *t, int fd)
+{
+  struct file *file = fd_acquire (t, fd);
+
+  if (file != NULL)
+    {
+      t->slots[fd]->file = NULL;
+      fd_release (t, fd);
+      lock_acquire (&t->lock);
+      bitmap_reset (t->used, fd);
+      lock_release (&t->lock);
+    }
+  return file;
+}
+
+/* Enlarges table T to SIZE slots, if it is smaller, which must
+   be FD_TABLE_INIT times a power of 2 no greater than
+   FD_TABLE_MAX.  Returns true if successful, false if memory is
+   short, in which case T is unchanged. */
+static bool
+grow (struct fd_table *t, size_t size)
+{
+  struct fd_slot **slots;
+  struct bitmap *used;
+  size_t i;
+
+  if (size <= t->size)
+    return true;
+
+  /* Zeroed, so that `fail' frees only slots allocated here. */
+  slots = calloc (size, sizeof *slots);
+  used = bitmap_create (size);
+  if (slots == NULL || used == NULL)
+    goto fail;
+  for (i = t->size; i < size; i++)
+    {
+      slots[i] = malloc (sizeof *slots[i]);
+      if (slots[i] == NULL)
+        goto fail;
+      lock_init (&slots[i]->lock);
+      slots[i]->file = NULL;
+    }
+
+  for (i = 0; i < t->size; i++)
+    {
+      slots[i] = t->slots[i];
+      bitmap_set (used, i, bitmap_test (t->used, i));
+    }
+  if (t->slots != NULL)
+    {
+      ASSERT (t->retired_cnt < FD_TABLE_GROWTHS);
+      t->retired[t->retired_cnt++] = t->slots;
+    }
+  if (t->used != NULL)
+    bitmap_destroy (t->used);
+  t->used = used;
+  t->slots = slots;
+  barrier ();
+  t->size = size;
+  return true;
+
+ fail:
+  if (slots != NULL)
+    for (i = t->size; i < size; i++)
+      free (slots[i]);
+  free (slots);
+  if (used != NULL)
+    bitmap_destroy (used);
+  return false;
+}
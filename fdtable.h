@@ -0,0 +1,16 @@
+#ifndef USERPROG_FDTABLE_H
+#define USERPROG_FDTABLE_H
+
+struct file;
+struct fd_table;
+
+struct fd_table *fd_table_create (void);
+struct fd_table *fd_table_fork (struct fd_table *);
+void fd_table_destroy (struct fd_table *);
+
+int fd_install (struct fd_table *, struct file *);
+struct file *fd_acquire (struct fd_table *, int fd);
+void fd_release (struct fd_table *, int fd);
+struct file *fd_remove (struct fd_table *, int fd);
+
+#endif /* userprog/fdtable.h */
@@ -0,0 +1,456 @@
+#include "vm/frame.h"
+#include <debug.h>
+#include <hash.h>
+#include <list.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "threads/zpool.h"
+#include "userprog/pagedir.h"
+#include "vm/page.h"
+#include "vm/swap.h"
+
+/* A physical frame holding a user page.
+
+   A frame may be mapped by more than one page directory at once:
+   read-only executable text is shared by every process running
+   the same program, and fork() shares every page of the parent
+   with the child until one of them writes to it.  REFCNT counts
+   those mappings, plus any reference taken by a caller that has
+   not mapped the frame yet, and the frame is freed when it drops
+   to 0.  PAGES is the reverse mapping: the supplemental page
+   table entries, each naming its process and user address, that
+   the frame is mapped for. */
+struct frame
+  {
+    void *kpage;                /* Kernel virtual address of frame. */
+    int refcnt;                 /* # of references. */
+    struct list pages;          /* `struct page's mapping this frame. */
+    struct hash_elem elem;      /* Element in `frames'. */
+    struct list_elem clock_elem; /* Element in `clock_list'. */
+
+    /* Shared executable text only.  Its contents are fully
+       determined by READ_BYTES bytes of INODE starting at OFS,
+       followed by zeros. */
+    struct inode *inode;        /* Backing inode, or null. */
+    off_t ofs;                  /* Offset in INODE. */
+    uint32_t read_bytes;        /* Bytes read from INODE. */
+    struct hash_elem share_elem; /* Element in `shared_frames'. */
+  };
+
+/* All user frames, keyed by kernel virtual address. */
+static struct hash frames;
+
+/* Shared read-only frames, keyed by (inode, offset, length). */
+static struct hash shared_frames;
+
+/* All user frames, in the order the clock hand visits them. */
+static struct list clock_list;
+static struct list_elem *clock_hand;
+
+/* Protects both tables, the clock, and every frame's reference
+   count and reverse mapping. */
+static struct lock frame_lock;
+
+/* Statistics. */
+static long long evict_cnt;     /* # of frames evicted. */
+
+static hash_hash_func frame_hash;
+static hash_less_func frame_less;
+static hash_hash_func shared_hash;
+static hash_less_func shared_less;
+static void frame_register (struct frame *, void *kpage);
+static void frame_unlink (struct frame *);
+static void *frame_evict (void);
+static struct frame *frame_lookup (void *kpage);
+static struct frame *shared_lookup (struct inode *, off_t, uint32_t);
+
+/* Initializes the frame tables. */
+void
+frame_init (void)
+{
+  lock_init (&frame_lock);
+  hash_init (&frames, frame_hash, frame_less, NULL);
+  hash_init (&shared_frames, shared_hash, shared_less, NULL);
+  list_init (&clock_list);
+  clock_hand = list_end (&clock_list);
+}
+
+/* Obtains a frame from the user pool, as zpool_get_page() with
+   FLAGS | PAL_USER, with a single reference.  If the pool is
+   empty, evicts a frame from some process to make room.  Returns
+   its kernel virtual address, or a null pointer if no memory is
+   available and nothing can be evicted.
+
+   The frame cannot be evicted until the caller maps it and
+   records the mapping with frame_attach(). */
+void *
+frame_alloc (enum palloc_flags flags)
+{
+  struct frame *f;
+  void *kpage;
+
+  f = malloc (sizeof *f);
+  if (f == NULL)
+    return NULL;
+  kpage = zpool_get_page (flags | PAL_USER);
+  if (kpage == NULL)
+    {
+      kpage = frame_evict ();
+      if (kpage != NULL && (flags & PAL_ZERO))
+        memset (kpage, 0, PGSIZE);
+    }
+  if (kpage == NULL)
+    {
+      free (f);
+      return NULL;
+    }
+  frame_register (f, kpage);
+  return kpage;
+}
+
+/* Obtains up to *CNT contiguous frames from the user pool, as
+   palloc_get_multiple() with FLAGS | PAL_USER, so that they can
+   be filled by a single read.  If that many are not available,
+   successively halves the request.  Each frame gets a single
+   reference and is later freed on its own with frame_free().
+   Returns the kernel virtual address of the first frame and
+   stores the number obtained in *CNT, or returns a null pointer
+   if not even one frame is available. */
+void *
+frame_alloc_multiple (enum palloc_flags flags, size_t *cnt)
+{
+  uint8_t *kpages = NULL;
+  size_t i;
+
+  ASSERT (*cnt > 0);
+
+  for (; *cnt > 1; *cnt /= 2)
+    {
+      kpages = palloc_get_multiple (flags | PAL_USER, *cnt);
+      if (kpages != NULL)
+        break;
+    }
+  if (kpages == NULL)
+    return frame_alloc (flags);
+
+  for (i = 0; i < *cnt; i++)
+    {
+      struct frame *f = malloc (sizeof *f);
+      if (f == NULL)
+        {
+          /* Keep the frames registered so far, give back the
+             rest. */
+          palloc_free_multiple (kpages + i * PGSIZE, *cnt - i);
+          *cnt = i;
+          break;
+        }
+      frame_register (f, kpages + i * PGSIZE);
+    }
+  return *cnt > 0 ? kpages : NULL;
+}
+
+/* Adds a reference to KPAGE, which is about to be mapped by one
+   more page directory. */
+void
+frame_ref (void *kpage)
+{
+  struct frame *f;
+
+  lock_acquire (&frame_lock);
+  f = frame_lookup (kpage);
+  ASSERT (f != NULL);
+  f->refcnt++;
+  lock_release (&frame_lock);
+}
+
+/* Records that supplemental page table entry P is now mapped to
+   KPAGE, using a reference the caller already holds. */
+void
+frame_attach (void *kpage, struct page *p)
+{
+  struct frame *f;
+
+  lock_acquire (&frame_lock);
+  f = frame_lookup (kpage);
+  ASSERT (f != NULL);
+  list_push_back (&f->pages, &p->frame_elem);
+  lock_release (&frame_lock);
+}
+
+/* Drops a reference to KPAGE, freeing it when the last page
+   directory mapping it lets go.  If P is nonnull, it is the
+   entry whose mapping goes away with the reference, which must
+   already have been removed from its page directory. */
+void
+frame_free (void *kpage, struct page *p)
+{
+  struct frame *f;
+
+  lock_acquire (&frame_lock);
+  f = frame_lookup (kpage);
+  ASSERT (f != NULL);
+  if (p != NULL)
+    list_remove (&p->frame_elem);
+  if (--f->refcnt > 0)
+    f = NULL;
+  else
+    frame_unlink (f);
+  lock_release (&frame_lock);
+
+  if (f != NULL)
+    {
+      palloc_free_page (f->kpage);
+      free (f);
+    }
+}
+
+/* Returns the number of references to KPAGE. */
+int
+frame_refcnt (void *kpage)
+{
+  struct frame *f;
+  int refcnt;
+
+  lock_acquire (&frame_lock);
+  f = frame_lookup (kpage);
+  ASSERT (f != NULL);
+  refcnt = f->refcnt;
+  lock_release (&frame_lock);
+  return refcnt;
+}
+
+/* If the page READ_BYTES bytes long at offset OFS in INODE is
+   already in memory, adds a reference to it and returns its
+   kernel virtual address.  Otherwise returns a null pointer. */
+void *
+frame_share_get (struct inode *inode, off_t ofs, uint32_t read_bytes)
+{
+  struct frame *f;
+  void *kpage = NULL;
+
+  lock_acquire (&frame_lock);
+  f = shared_lookup (inode, ofs, read_bytes);
+  if (f != NULL)
+    {
+      f->refcnt++;
+      kpage = f->kpage;
+    }
+  lock_release (&frame_lock);
+  return kpage;
+}
+
+/* Offers KPAGE, a frame obtained from frame_alloc() and freshly
+   read from INODE at OFS, for sharing.  If another process read
+   the same page in the meantime, KPAGE is freed and that page is
+   referenced and returned instead; otherwise KPAGE itself is
+   returned. */
+void *
+frame_share_add (struct inode *inode, off_t ofs, uint32_t read_bytes,
+                 void *kpage)
+{
+  struct frame *f;
+
+  lock_acquire (&frame_lock);
+  f = shared_lookup (inode, ofs, read_bytes);
+  if (f != NULL)
+    f->refcnt++;
+  else
+    {
+      f = frame_lookup (kpage);
+      ASSERT (f != NULL && f->inode == NULL);
+      f->inode = inode;
+      f->ofs = ofs;
+      f->read_bytes = read_bytes;
+      hash_insert (&shared_frames, &f->share_elem);
+    }
+  lock_release (&frame_lock);
+
+  if (f->kpage != kpage)
+    frame_free (kpage, NULL);
+  return f->kpage;
+}
+
+/* Prints frame table statistics. */
+void
+frame_print_stats (void)
+{
+  printf ("Frames: %lld evicted\n", evict_cnt);
+}
+
+/* Sets up F as the frame at KPAGE, with one reference and no
+   mappings, and adds it to the tables. */
+static void
+frame_register (struct frame *f, void *kpage)
+{
+  f->kpage = kpage;
+  f->refcnt = 1;
+  list_init (&f->pages);
+  f->inode = NULL;
+
+  lock_acquire (&frame_lock);
+  hash_insert (&frames, &f->elem);
+  list_push_back (&clock_list, &f->clock_elem);
+  lock_release (&frame_lock);
+}
+
+/* Removes F from the tables and the clock.  Caller must hold
+   frame_lock. */
+static void
+frame_unlink (struct frame *f)
+{
+  hash_delete (&frames, &f->elem);
+  if (f->inode != NULL)
+    hash_delete (&shared_frames, &f->share_elem);
+  if (clock_hand == &f->clock_elem)
+    clock_hand = list_next (clock_hand);
+  list_remove (&f->clock_elem);
+}
+
+/* Chooses a frame to evict with the clock (second-chance)
+   algorithm, evicts its page, and returns its kernel virtual
+   address for reuse, or returns a null pointer if no frame can
+   be evicted.
+
+   The hand sweeps the frames in order.  A frame whose page was
+   accessed since the last sweep has its accessed bit cleared
+   and is passed over; the first one that was not is the victim.
+   Only frames mapped by exactly one process are candidates:
+   frames still being set up have references but no mapping, and
+   frames shared between processes are usually hot and would
+   need every sharer's page lock.  The owner's page lock is only
+   tried, never waited for, because the owner may itself be
+   waiting for frame_lock to allocate a frame.  Dirty pages that
+   must go to swap reserve a slot before they are chosen, so that
+   a full swap partition makes eviction pick something else
+   rather than fail. */
+static void *
+frame_evict (void)
+{
+  struct frame *victim = NULL;
+  struct page *p = NULL;
+  size_t slot = SWAP_NONE;
+  bool locked = false;
+  size_t i, n;
+
+  lock_acquire (&frame_lock);
+  n = 2 * list_size (&clock_list);
+  for (i = 0; i < n && victim == NULL; i++)
+    {
+      struct frame *f;
+      uint32_t *pd;
+
+      if (clock_hand == list_end (&clock_list))
+        clock_hand = list_begin (&clock_list);
+      f = list_entry (clock_hand, struct frame, clock_elem);
+      clock_hand = list_next (clock_hand);
+
+      if (f->refcnt != 1 || list_size (&f->pages) != 1)
+        continue;
+      p = list_entry (list_front (&f->pages), struct page, frame_elem);
+      locked = !lock_held_by_current_thread (&p->owner->page_lock);
+      if (locked && !lock_try_acquire (&p->owner->page_lock))
+        continue;
+
+      pd = p->owner->pagedir;
+      if (pagedir_is_accessed (pd, p->upage))
+        pagedir_set_accessed (pd, p->upage, false);
+      else if (!page_needs_swap (p) || (slot = swap_alloc ()) != SWAP_NONE)
+        {
+          list_remove (&p->frame_elem);
+          frame_unlink (f);
+          victim = f;
+          evict_cnt++;
+          break;
+        }
+      if (locked)
+        lock_release (&p->owner->page_lock);
+    }
+  lock_release (&frame_lock);
+
+  if (victim != NULL)
+    {
+      void *kpage = victim->kpage;
+
+      page_evict (p, kpage, slot);
+      if (locked)
+        lock_release (&p->owner->page_lock);
+      free (victim);
+      return kpage;
+    }
+  return NULL;
+}
+
+/* Returns the frame at KPAGE, or a null pointer if there is
+   none.  Caller must hold frame_lock. */
+static struct frame *
+frame_lookup (void *kpage)
+{
+  struct frame key;
+  struct hash_elem *e;
+
+  key.kpage = kpage;
+  e = hash_find (&frames, &key.elem);
+  return e != NULL ? hash_entry (e, struct frame, elem) : NULL;
+}
+
+/* Returns the shared frame with the given key, or a null
+   pointer if there is none.  Caller must hold frame_lock. */
+static struct frame *
+shared_lookup (struct inode *inode, off_t ofs, uint32_t read_bytes)
+{
+  struct frame key;
+  struct hash_elem *e;
+
+  key.inode = inode;
+  key.ofs = ofs;
+  key.read_bytes = read_bytes;
+  e = hash_find (&shared_frames, &key.share_elem);
+  return e != NULL ? hash_entry (e, struct frame, share_elem) : NULL;
+}
+
+/* Returns a hash value for frame F. */
+static unsigned
+frame_hash (const struct hash_elem *f_, void *aux UNUSED)
+{
+  const struct frame *f = hash_entry (f_, struct frame, elem);
+  return hash_bytes (&f->kpage, sizeof f->kpage);
+}
+
+/* Returns true if frame A precedes frame B. */
+static bool
+frame_less (const struct hash_elem *a_, const struct hash_elem *b_,
+            void *aux UNUSED)
+{
+  const struct frame *a = hash_entry (a_, struct frame, elem);
+  const struct frame *b = hash_entry (b_, struct frame, elem);
+
+  return a->kpage < b->kpage;
+}
+
+/* Returns a hash value for shared frame F. */
+static unsigned
+shared_hash (const struct hash_elem *f_, void *aux UNUSED)
+{
+  const struct frame *f = hash_entry (f_, struct frame, share_elem);
+  return (hash_bytes (&f->inode, sizeof f->inode)
+          ^ hash_int (f->ofs) ^ hash_int (f->read_bytes));
+}
+
+/* Returns true if shared frame A's key precedes B's. */
+static bool
+shared_less (const struct hash_elem *a_, const struct hash_elem *b_,
+             void *aux UNUSED)
+{
+  const struct frame *a = hash_entry (a_, struct frame, share_elem);
+  const struct frame *b = hash_entry (b_, struct frame, share_elem);
+
+  if (a->inode != b->inode)
+    return a->inode < b->inode;
+  if (a->ofs != b->ofs)
+    return a->ofs < b->ofs;
+  return a->read_bytes < b->read_bytes;
+}
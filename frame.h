@@ -0,0 +1,26 @@
+#ifndef VM_FRAME_H
+#define VM_FRAME_H
+
+#include <stdint.h>
+#include "filesys/off_t.h"
+#include "threads/palloc.h"
+
+struct inode;
+struct page;
+
+void frame_init (void);
+
+void *frame_alloc (enum palloc_flags);
+void *frame_alloc_multiple (enum palloc_flags, size_t *cnt);
+void frame_ref (void *kpage);
+void frame_attach (void *kpage, struct page *);
+void frame_free (void *kpage, struct page *);
+int frame_refcnt (void *kpage);
+
+void *frame_share_get (struct inode *, off_t, uint32_t read_bytes);
+void *frame_share_add (struct inode *, off_t, uint32_t read_bytes,
+                       void *kpage);
+
+void frame_print_stats (void);
+
+#endif /* vm/frame.h */
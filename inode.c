@@ -0,0 +1,448 @@
+#include "filesys/inode.h"
+#include <list.h>
+#include <debug.h>
+#include <round.h>
+#include <string.h>
+#include "filesys/cache.h"
+#include "filesys/filesys.h"
+#include "filesys/free-map.h"
+#include "threads/malloc.h"
+#ifdef USERPROG
+#include "userprog/process.h"
+#endif
+
+/* Identifies an inode. */
+#define INODE_MAGIC 0x494e4f44
+
+/* Layout of an inode's sector list.
+
+   The first DIRECT_CNT entries of `sectors' name data sectors
+   directly.  The next names an indirect block, a sector holding
+   PTRS_PER_SECTOR further data sector numbers, and the last names
+   a doubly indirect block, whose entries name indirect blocks.
+   An entry of 0 means the sector has not been allocated; reading
+   it yields zeros.  Sector 0 always holds the free map, so it is
+   never part of a file's data. */
+#define DIRECT_CNT 123
+#define INDIRECT_IDX DIRECT_CNT
+#define DBL_INDIRECT_IDX (DIRECT_CNT + 1)
+#define SECTOR_CNT (DIRECT_CNT + 2)
+#define PTRS_PER_SECTOR ((size_t) (BLOCK_SECTOR_SIZE \
+                                   / sizeof (block_sector_t)))
+
+/* Longest file an inode can describe. */
+#define INODE_MAX_LENGTH                                        \
+  ((off_t) ((DIRECT_CNT + PTRS_PER_SECTOR                       \
+             + PTRS_PER_SECTOR * PTRS_PER_SECTOR) * BLOCK_SECTOR_SIZE))
+
+/* On-disk inode.
+   Must be exactly BLOCK_SECTOR_SIZE bytes long. */
+struct inode_disk
+  {
+    block_sector_t sectors[SECTOR_CNT]; /* Data and index sectors. */
+    off_t length;                       /* File size in bytes. */
+    unsigned magic;                     /* Magic number. */
+    uint32_t unused[1];                 /* Not used. */
+  };
+
+/* In-memory inode. */
+struct inode
+  {
+    struct list_elem elem;              /* Element in inode list. */
+    block_sector_t sector;              /* Sector number of disk location. */
+    int open_cnt;                       /* Number of openers. */
+    bool removed;                       /* True if deleted, false otherwise. */
+    int deny_write_cnt;                 /* 0: writes ok, >0: deny writes. */
+    block_sector_t next_hint;           /* Where to allocate next. */
+    struct inode_disk data;             /* Inode content. */
+  };
+
+/* A sector's worth of zeros, for clearing new sectors. */
+static const uint8_t zeros[BLOCK_SECTOR_SIZE];
+
+/* Allocates a sector for INODE, as close after the last one it
+   allocated as the free map allows, fills it with zeros and
+   stores its number in *SECTORP.  Returns false if the disk is
+   full. */
+static bool
+allocate_sector (struct inode *inode, block_sector_t *sectorp)
+{
+  if (!free_map_allocate_near (inode->next_hint, 1, sectorp))
+    return false;
+  cache_write (*sectorp, zeros);
+  inode->next_hint = *sectorp + 1;
+  return true;
+}
+
+/* Returns entry IDX of INODE's own sector list, or 0 if it is
+   unallocated.  If ALLOCATE, allocates the sector first if
+   necessary, so that 0 means the disk is full. */
+static block_sector_t
+lookup_direct (struct inode *inode, size_t idx, bool allocate)
+{
+  block_sector_t *slot = &inode->data.sectors[idx];
+
+  if (*slot == 0 && allocate && allocate_sector (inode, slot))
+    cache_write (inode->sector, &inode->data);
+  return *slot;
+}
+
+/* Like lookup_direct(), but for entry IDX of index block INDEX. */
+static block_sector_t
+lookup_indirect (struct inode *inode, block_sector_t index, size_t idx,
+                 bool allocate)
+{
+  block_sector_t sector;
+  size_t ofs = idx * sizeof sector;
+
+  cache_read_at (index, &sector, ofs, sizeof sector);
+  if (sector == 0 && allocate && allocate_sector (inode, &sector))
+    cache_write_at (index, &sector, ofs, sizeof sector);
+  return sector;
+}
+
+/* Returns the block device sector that contains byte offset POS
+   within INODE, or 0 if that sector has not been allocated.  If
+   ALLOCATE, allocates it and any index blocks on the way to it
+   first, so that 0 means the disk is full.  POS must be less
+   than INODE_MAX_LENGTH. */
+static block_sector_t
+byte_to_sector (struct inode *inode, off_t pos, bool allocate)
+{
+  size_t idx = pos / BLOCK_SECTOR_SIZE;
+  block_sector_t index;
+
+  ASSERT (inode != NULL);
+  ASSERT (pos >= 0 && pos < INODE_MAX_LENGTH);
+
+  if (idx < DIRECT_CNT)
+    return lookup_direct (inode, idx, allocate);
+  idx -= DIRECT_CNT;
+
+  if (idx < PTRS_PER_SECTOR)
+    {
+      index = lookup_direct (inode, INDIRECT_IDX, allocate);
+      return index != 0 ? lookup_indirect (inode, index, idx, allocate) : 0;
+    }
+  idx -= PTRS_PER_SECTOR;
+
+  index = lookup_direct (inode, DBL_INDIRECT_IDX, allocate);
+  if (index != 0)
+    index = lookup_indirect (inode, index, idx / PTRS_PER_SECTOR, allocate);
+  if (index != 0)
+    return lookup_indirect (inode, index, idx % PTRS_PER_SECTOR, allocate);
+  return 0;
+}
+
+/* Releases SECTOR and, if it is an index block with LEVELS
+   levels of sectors below it, every sector below it. */
+static void
+release_tree (block_sector_t sector, int levels)
+{
+  if (levels > 0)
+    {
+      size_t i;
+
+      for (i = 0; i < PTRS_PER_SECTOR; i++)
+        {
+          block_sector_t child;
+
+          cache_read_at (sector, &child, i * sizeof child, sizeof child);
+          if (child != 0)
+            release_tree (child, levels - 1);
+        }
+    }
+  free_map_release (sector, 1);
+}
+
+/* Releases all of INODE's data and index sectors, but not the
+   sector holding the inode itself. */
+static void
+deallocate (struct inode *inode)
+{
+  size_t i;
+
+  for (i = 0; i < SECTOR_CNT; i++)
+    if (inode->data.sectors[i] != 0)
+      {
+        int levels = i < DIRECT_CNT ? 0 : i == INDIRECT_IDX ? 1 : 2;
+        release_tree (inode->data.sectors[i], levels);
+        inode->data.sectors[i] = 0;
+      }
+}
+
+/* List of open inodes, so that opening a single inode twice
+   returns the same `struct inode'. */
+static struct list open_inodes;
+
+/* Initializes the inode module. */
+void
+inode_init (void)
+{
+  list_init (&open_inodes);
+}
+
+/* Initializes an inode with LENGTH bytes of data and
+   writes the new inode to sector SECTOR on the file system
+   device.  All LENGTH bytes are allocated now, so later writes
+   within them cannot fail for lack of space; the file still
+   grows if written past its end.
+   Returns true if successful.
+   Returns false if memory or disk allocation fails. */
+bool
+inode_create (block_sector_t sector, off_t length)
+{
+  struct inode_disk *disk_inode;
+  struct inode *inode;
+  off_t pos;
+
+  ASSERT (length >= 0);
+
+  /* If this assertion fails, the inode structure is not exactly
+     one sector in size, and you should fix that. */
+  ASSERT (sizeof *disk_inode == BLOCK_SECTOR_SIZE);
+
+  if (length > INODE_MAX_LENGTH)
+    return false;
+
+  disk_inode = calloc (1, sizeof *disk_inode);
+  if (disk_inode == NULL)
+    return false;
+  disk_inode->magic = INODE_MAGIC;
+  cache_write (sector, disk_inode);
+  free (disk_inode);
+
+  inode = inode_open (sector);
+  if (inode == NULL)
+    return false;
+  for (pos = 0; pos < length; pos += BLOCK_SECTOR_SIZE)
+    if (byte_to_sector (inode, pos, true) == 0)
+      {
+        deallocate (inode);
+        inode_close (inode);
+        return false;
+      }
+  inode->data.length = length;
+  cache_write (inode->sector, &inode->data);
+  inode_close (inode);
+  return true;
+}
+
+/* Reads an inode from SECTOR
+   and returns a `struct inode' that contains it.
+   Returns a null pointer if memory allocation fails. */
+struct inode *
+inode_open (block_sector_t sector)
+{
+  struct list_elem *e;
+  struct inode *inode;
+
+  /* Check whether this inode is already open. */
+  for (e = list_begin (&open_inodes); e != list_end (&open_inodes);
+       e = list_next (e))
+    {
+      inode = list_entry (e, struct inode, elem);
+      if (inode->sector == sector)
+        {
+          inode_reopen (inode);
+          return inode;
+        }
+    }
+
+  /* Allocate memory. */
+  inode = malloc (sizeof *inode);
+  if (inode == NULL)
+    return NULL;
+
+  /* Initialize. */
+  list_push_front (&open_inodes, &inode->elem);
+  inode->sector = sector;
+  inode->open_cnt = 1;
+  inode->deny_write_cnt = 0;
+  inode->removed = false;
+  cache_read (inode->sector, &inode->data);
+
+  /* Grow the file from where its data ends. */
+  inode->next_hint = sector + 1;
+  if (inode->data.length > 0)
+    {
+      block_sector_t last = byte_to_sector (inode, inode->data.length - 1,
+                                            false);
+      if (last != 0)
+        inode->next_hint = last + 1;
+    }
+  return inode;
+}
+
+/* Reopens and returns INODE. */
+struct inode *
+inode_reopen (struct inode *inode)
+{
+  if (inode != NULL)
+    inode->open_cnt++;
+  return inode;
+}
+
+/* Returns INODE's inode number. */
+block_sector_t
+inode_get_inumber (const struct inode *inode)
+{
+  return inode->sector;
+}
+
+/* Closes INODE and writes it to disk.
+   If this was the last reference to INODE, frees its memory.
+   If INODE was also a removed inode, frees its blocks. */
+void
+inode_close (struct inode *inode)
+{
+  /* Ignore null pointer. */
+  if (inode == NULL)
+    return;
+
+  /* Release resources if this was the last opener. */
+  if (--inode->open_cnt == 0)
+    {
+      /* Remove from inode list. */
+      list_remove (&inode->elem);
+
+      /* Deallocate blocks if removed.  The sector may later hold
+         a new file, so drop any parsed executable cached under
+         it. */
+      if (inode->removed)
+        {
+#ifdef USERPROG
+          elf_cache_invalidate (inode);
+#endif
+          deallocate (inode);
+          free_map_release (inode->sector, 1);
+        }
+
+      free (inode);
+    }
+}
+
+/* Marks INODE to be deleted when it is closed by the last caller who
+   has it open. */
+void
+inode_remove (struct inode *inode)
+{
+  ASSERT (inode != NULL);
+  inode->removed = true;
+}
+
+/* Reads SIZE bytes from INODE into BUFFER, starting at position OFFSET.
+   Returns the number of bytes actually read, which may be less
+   than SIZE if an error occurs or end of file is reached. */
+off_t
+inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
+{
+  uint8_t *buffer = buffer_;
+  off_t bytes_read = 0;
+
+  while (size > 0)
+    {
+      /* Bytes left in inode, bytes left in sector, lesser of the two. */
+      off_t inode_left = inode_length (inode) - offset;
+      int sector_ofs = offset % BLOCK_SECTOR_SIZE;
+      int sector_left = BLOCK_SECTOR_SIZE - sector_ofs;
+      int min_left = inode_left < sector_left ? inode_left : sector_left;
+      block_sector_t sector_idx;
+
+      /* Number of bytes to actually copy out of this sector. */
+      int chunk_size = size < min_left ? size : min_left;
+      if (chunk_size <= 0)
+        break;
+
+      /* A sector never written reads as zeros. */
+      sector_idx = byte_to_sector (inode, offset, false);
+      if (sector_idx != 0)
+        cache_read_at (sector_idx, buffer + bytes_read, sector_ofs,
+                       chunk_size);
+      else
+        memset (buffer + bytes_read, 0, chunk_size);
+
+      /* Advance. */
+      size -= chunk_size;
+      offset += chunk_size;
+      bytes_read += chunk_size;
+    }
+
+  return bytes_read;
+}
+
+/* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET.
+   Returns the number of bytes actually written, which may be
+   less than SIZE if the disk fills up, the write reaches
+   INODE_MAX_LENGTH, or writes are denied.  Writing past end of
+   file extends it, allocating only the sectors written; any gap
+   left before OFFSET reads as zeros. */
+off_t
+inode_write_at (struct inode *inode, const void *buffer_, off_t size,
+                off_t offset)
+{
+  const uint8_t *buffer = buffer_;
+  off_t bytes_written = 0;
+
+  if (inode->deny_write_cnt)
+    return 0;
+  if (offset >= INODE_MAX_LENGTH)
+    return 0;
+  if (size > INODE_MAX_LENGTH - offset)
+    size = INODE_MAX_LENGTH - offset;
+
+  while (size > 0)
+    {
+      int sector_ofs = offset % BLOCK_SECTOR_SIZE;
+      int sector_left = BLOCK_SECTOR_SIZE - sector_ofs;
+      block_sector_t sector_idx;
+
+      /* Number of bytes to actually write into this sector. */
+      int chunk_size = size < sector_left ? size : sector_left;
+
+      sector_idx = byte_to_sector (inode, offset, true);
+      if (sector_idx == 0)
+        break;
+      cache_write_at (sector_idx, buffer + bytes_written, sector_ofs,
+                      chunk_size);
+
+      /* Advance. */
+      size -= chunk_size;
+      offset += chunk_size;
+      bytes_written += chunk_size;
+    }
+
+  if (bytes_written > 0 && offset > inode->data.length)
+    {
+      inode->data.length = offset;
+      cache_write (inode->sector, &inode->data);
+    }
+  return bytes_written;
+}
+
+/* Disables writes to INODE.
+   May be called at most once per inode opener. */
+void
+inode_deny_write (struct inode *inode)
+{
+  inode->deny_write_cnt++;
+  ASSERT (inode->deny_write_cnt <= inode->open_cnt);
+}
+
+/* Re-enables writes to INODE.
+   Must be called once by each inode opener who has called
+   inode_deny_write() on the inode, before closing the inode. */
+void
+inode_allow_write (struct inode *inode)
+{
+  ASSERT (inode->deny_write_cnt > 0);
+  ASSERT (inode->deny_write_cnt <= inode->open_cnt);
+  inode->deny_write_cnt--;
+}
+
+/* Returns the length, in bytes, of INODE's data. */
+off_t
+inode_length (const struct inode *inode)
+{
+  return inode->data.length;
+}
@@ -0,0 +1,435 @@
+#include "userprog/ioring.h"
+#include <debug.h>
+#include <list.h>
+#include <round.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/conout.h"
+#include "filesys/file.h"
+#include "filesys/filesys.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/fdtable.h"
+#include "userprog/process.h"
+#include "userprog/syscall.h"
+#include "vm/frame.h"
+#include "vm/page.h"
+
+/* Asynchronous I/O rings.
+
+   A process that calls ring_setup() gets a region of memory it
+   shares with the kernel, laid out as described with `struct
+   ring_header' in <syscall.h>.  The region's frames are pinned
+   for as long as the rings exist: the kernel holds a reference to
+   each, which keeps the frame table from evicting them, so the
+   kernel reaches the region through its own addresses in
+   `kpages' without any page faults, from any thread.
+
+   ring_enter() moves queued submissions onto a queue served by a
+   small pool of kernel worker threads, and returns as soon as it
+   has done so unless asked to wait for completions.  The workers
+   perform each operation with the owner's descriptor table, using
+   buffers within the region, and post the result to the
+   completion queue.  The process is then free to compute while
+   its I/O is in progress, and may submit any number of
+   operations with one trap.
+
+   At most ENTRIES operations are in flight or awaiting
+   collection at once, so the completion queue never
+   overflows. */
+struct ioring
+  {
+    uint8_t *base;              /* User address of the region. */
+    size_t page_cnt;            /* Number of pages in the region. */
+    void **kpages;              /* Kernel address of each page. */
+    unsigned entries;           /* Entries in each queue. */
+    struct fd_table *fds;       /* Owner's descriptors. */
+    struct lock lock;           /* Protects cq_tail and `in_flight'. */
+    struct condition done;      /* Signaled on each completion. */
+    unsigned in_flight;         /* Submitted but not yet completed. */
+  };
+
+/* A submitted operation, waiting for or in the hands of a
+   worker. */
+struct ioring_req
+  {
+    struct ioring *ring;        /* Ring it came from. */
+    struct ring_sqe sqe;        /* Copy of its submission entry. */
+    struct list_elem elem;      /* Element in `queue'. */
+  };
+
+/* Number of worker threads. */
+#define IORING_WORKERS 4
+
+/* Operations waiting for a worker, from all rings. */
+static struct list queue;
+static struct lock queue_lock;
+static struct condition queue_nonempty;
+
+static thread_func worker NO_RETURN;
+static int execute (struct ioring *, const struct ring_sqe *);
+static int transfer (struct ioring *, int fd, const void *ubuf,
+                     size_t size, bool write);
+static int open_file (struct ioring *, const char *uname, size_t size);
+static bool in_region (const struct ioring *, const void *, size_t);
+static void *ring_kaddr (const struct ioring *, size_t ofs);
+static unsigned cq_pending (const struct ioring *);
+static void ring_free (struct ioring *, size_t mapped);
+
+/* Starts the worker threads. */
+void
+ioring_init (void)
+{
+  int i;
+
+  list_init (&queue);
+  lock_init (&queue_lock);
+  cond_init (&queue_nonempty);
+  for (i = 0; i < IORING_WORKERS; i++)
+    thread_create ("ioring", PRI_DEFAULT, worker, NULL);
+}
+
+/* Gives the current process rings with ENTRIES entries each, a
+   power of 2 no greater than RING_MAX_ENTRIES, in a region of
+   SIZE bytes at page-aligned user address ADDR.  Returns 0 if
+   successful, -1 if the arguments are invalid, the process
+   already has rings, part of the region is already in use, or
+   memory is short. */
+int
+ioring_setup (unsigned entries, void *addr, unsigned size)
+{
+  struct thread *cur = thread_current ();
+  uint8_t *base = addr;
+  struct ioring *r;
+  size_t i;
+
+  if (cur->ioring != NULL
+      || entries == 0 || entries > RING_MAX_ENTRIES
+      || (entries & (entries - 1)) != 0
+      || size < RING_DATA_OFS (entries) || size > RING_MAX_SIZE
+      || base == NULL || pg_ofs (base) != 0
+      || (uint32_t) base + size < (uint32_t) base
+      || base + size > (uint8_t *) PHYS_BASE - cur->stack_limit)
+    return -1;
+
+  /* Workers may open files before the process does. */
+  if (cur->fds == NULL)
+    {
+      cur->fds = fd_table_create ();
+      if (cur->fds == NULL)
+        return -1;
+    }
+
+  r = malloc (sizeof *r);
+  if (r == NULL)
+    return -1;
+  r->base = base;
+  r->page_cnt = DIV_ROUND_UP (size, PGSIZE);
+  r->kpages = calloc (r->page_cnt, sizeof *r->kpages);
+  r->entries = entries;
+  r->fds = cur->fds;
+  lock_init (&r->lock);
+  cond_init (&r->done);
+  r->in_flight = 0;
+  if (r->kpages == NULL)
+    {
+      free (r);
+      return -1;
+    }
+
+  for (i = 0; i < r->page_cnt; i++)
+    {
+      r->kpages[i] = frame_alloc (PAL_ZERO);
+      if (r->kpages[i] == NULL
+          || !page_add_kernel (base + i * PGSIZE, r->kpages[i]))
+        {
+          ring_free (r, i);
+          return -1;
+        }
+    }
+  ((struct ring_header *) r->kpages[0])->entries = entries;
+  cur->ioring = r;
+  return 0;
+}
+
+/* Hands up to TO_SUBMIT of the current process's queued
+   submissions to the workers, stopping early if the submission
+   queue runs out or enough operations are outstanding to fill
+   the completion queue.  Then waits until at least MIN_COMPLETE
+   completions are ready to collect, or until nothing is left in
+   flight.  Returns the number of operations submitted, or -1 if
+   the process has no rings. */
+int
+ioring_enter (unsigned to_submit, unsigned min_complete)
+{
+  struct ioring *r = thread_current ()->ioring;
+  volatile struct ring_header *h;
+  unsigned submitted = 0;
+
+  if (r == NULL)
+    return -1;
+  h = r->kpages[0];
+
+  lock_acquire (&r->lock);
+  while (submitted < to_submit && h->sq_head != h->sq_tail
+         && r->in_flight + cq_pending (r) < r->entries)
+    {
+      struct ioring_req *req = malloc (sizeof *req);
+      size_t ofs;
+
+      if (req == NULL)
+        break;
+      ofs = RING_SQ_OFS + (h->sq_head % r->entries) * sizeof req->sqe;
+      req->ring = r;
+      memcpy (&req->sqe, ring_kaddr (r, ofs), sizeof req->sqe);
+      h->sq_head++;
+      r->in_flight++;
+      submitted++;
+
+      lock_acquire (&queue_lock);
+      list_push_back (&queue, &req->elem);
+      cond_signal (&queue_nonempty, &queue_lock);
+      lock_release (&queue_lock);
+    }
+  while (cq_pending (r) < min_complete && r->in_flight > 0)
+    cond_wait (&r->done, &r->lock);
+  lock_release (&r->lock);
+  return submitted;
+}
+
+/* Tears down the current process's rings, if it has any, after
+   waiting for every operation in flight to finish.  Must be
+   called before the process's page table and descriptors are
+   destroyed. */
+void
+ioring_destroy (void)
+{
+  struct thread *cur = thread_current ();
+  struct ioring *r = cur->ioring;
+
+  if (r == NULL)
+    return;
+  lock_acquire (&r->lock);
+  while (r->in_flight > 0)
+    cond_wait (&r->done, &r->lock);
+  lock_release (&r->lock);
+  cur->ioring = NULL;
+  ring_free (r, r->page_cnt);
+}
+
+/* Performs queued operations, forever. */
+static void
+worker (void *aux UNUSED)
+{
+  for (;;)
+    {
+      struct ioring_req *req;
+      struct ioring *r;
+      volatile struct ring_header *h;
+      struct ring_cqe *cqe;
+      int result;
+
+      lock_acquire (&queue_lock);
+      while (list_empty (&queue))
+        cond_wait (&queue_nonempty, &queue_lock);
+      req = list_entry (list_pop_front (&queue), struct ioring_req, elem);
+      lock_release (&queue_lock);
+
+      r = req->ring;
+      result = execute (r, &req->sqe);
+
+      lock_acquire (&r->lock);
+      h = r->kpages[0];
+      cqe = ring_kaddr (r, RING_CQ_OFS (r->entries)
+                           + (h->cq_tail % r->entries) * sizeof *cqe);
+      cqe->user_data = req->sqe.user_data;
+      cqe->result = result;
+      barrier ();
+      h->cq_tail++;
+      r->in_flight--;
+      cond_broadcast (&r->done, &r->lock);
+      lock_release (&r->lock);
+      free (req);
+    }
+}
+
+/* Performs the operation in SQE for ring R and returns its
+   result. */
+static int
+execute (struct ioring *r, const struct ring_sqe *sqe)
+{
+  struct file *file;
+
+  switch (sqe->opcode)
+    {
+    case RING_OP_READ:
+      return transfer (r, sqe->fd, sqe->buf, sqe->len, false);
+
+    case RING_OP_WRITE:
+      return transfer (r, sqe->fd, sqe->buf, sqe->len, true);
+
+    case RING_OP_OPEN:
+      return open_file (r, sqe->buf, sqe->len);
+
+    case RING_OP_CLOSE:
+      file = fd_remove (r->fds, sqe->fd);
+      if (file == NULL)
+        return -1;
+      lock_acquire (&filesys_lock);
+      file_close (file);
+      lock_release (&filesys_lock);
+      return 0;
+
+    default:
+      return -1;
+    }
+}
+
+/* Reads or writes SIZE bytes between descriptor FD and UBUF,
+   which must lie within R's region.  Descriptor 1 writes to the
+   console.  Returns the number of bytes transferred, or -1 on
+   error. */
+static int
+transfer (struct ioring *r, int fd, const void *ubuf, size_t size,
+          bool write)
+{
+  size_t ofs = (const uint8_t *) ubuf - r->base;
+  struct file *file = NULL;
+  size_t total = 0;
+
+  if (!in_region (r, ubuf, size))
+    return -1;
+  if (!write || fd != STDOUT_FILENO)
+    {
+      file = fd_acquire (r->fds, fd);
+      if (file == NULL)
+        return -1;
+    }
+
+  /* The region is only contiguous in user space, so go a page at
+     a time. */
+  while (total < size)
+    {
+      size_t page_left = PGSIZE - (ofs + total) % PGSIZE;
+      size_t chunk = size - total < page_left ? size - total : page_left;
+      void *kaddr = ring_kaddr (r, ofs + total);
+      off_t n = chunk;
+
+      if (file == NULL)
+        conout_write (kaddr, chunk);
+      else
+        {
+          lock_acquire (&filesys_lock);
+          if (write)
+            {
+              n = file_write (file, kaddr, chunk);
+              if (n > 0)
+                elf_cache_invalidate (file_get_inode (file));
+            }
+          else
+            n = file_read (file, kaddr, chunk);
+          lock_release (&filesys_lock);
+        }
+      total += n;
+      if ((size_t) n < chunk)
+        break;
+    }
+  if (file != NULL)
+    fd_release (r->fds, fd);
+  return total;
+}
+
+/* Opens the file whose name is the SIZE bytes at UNAME, which
+   must lie within R's region, or the part of them before a null
+   byte.  Returns the new descriptor, or -1 on error. */
+static int
+open_file (struct ioring *r, const char *uname, size_t size)
+{
+  size_t ofs = (const uint8_t *) uname - r->base;
+  struct file *file;
+  char *name;
+  size_t copied;
+  int fd;
+
+  if (size == 0 || size >= PGSIZE || !in_region (r, uname, size))
+    return -1;
+  name = malloc (size + 1);
+  if (name == NULL)
+    return -1;
+  for (copied = 0; copied < size; )
+    {
+      size_t page_left = PGSIZE - (ofs + copied) % PGSIZE;
+      size_t chunk = size - copied < page_left ? size - copied : page_left;
+      memcpy (name + copied, ring_kaddr (r, ofs + copied), chunk);
+      copied += chunk;
+    }
+  name[size] = '\0';
+
+  lock_acquire (&filesys_lock);
+  file = filesys_open (name);
+  lock_release (&filesys_lock);
+  free (name);
+  if (file == NULL)
+    return -1;
+
+  fd = fd_install (r->fds, file);
+  if (fd < 0)
+    {
+      lock_acquire (&filesys_lock);
+      file_close (file);
+      lock_release (&filesys_lock);
+    }
+  return fd;
+}
+
+/* Returns true if the SIZE bytes at user address UADDR lie
+   entirely within R's region. */
+static bool
+in_region (const struct ioring *r, const void *uaddr, size_t size)
+{
+  const uint8_t *p = uaddr;
+  size_t region_size = r->page_cnt * PGSIZE;
+
+  return (p >= r->base && (size_t) (p - r->base) <= region_size
+          && size <= region_size - (p - r->base));
+}
+
+/* Returns the kernel address of the byte at offset OFS in R's
+   region. */
+static void *
+ring_kaddr (const struct ioring *r, size_t ofs)
+{
+  ASSERT (ofs < r->page_cnt * PGSIZE);
+  return (uint8_t *) r->kpages[ofs / PGSIZE] + ofs % PGSIZE;
+}
+
+/* Returns the number of completions waiting for R's owner to
+   collect them.  The owner controls cq_head, so the result is
+   capped at the queue's size. */
+static unsigned
+cq_pending (const struct ioring *r)
+{
+  volatile struct ring_header *h = r->kpages[0];
+  unsigned pending = h->cq_tail - h->cq_head;
+
+  return pending < r->entries ? pending : r->entries;
+}
+
+/* Unmaps the first MAPPED pages of R's region from the current
+   process, drops the kernel's references to all of its frames,
+   and frees R. */
+static void
+ring_free (struct ioring *r, size_t mapped)
+{
+  size_t i;
+
+  for (i = 0; i < mapped; i++)
+    page_remove (r->base + i * PGSIZE);
+  for (i = 0; i < r->page_cnt; i++)
+    if (r->kpages[i] != NULL)
+      frame_free (r->kpages[i], NULL);
+  free (r->kpages);
+  free (r);
+}
@@ -0,0 +1,9 @@
+#ifndef USERPROG_IORING_H
+#define USERPROG_IORING_H
+
+void ioring_init (void);
+int ioring_setup (unsigned entries, void *addr, unsigned size);
+int ioring_enter (unsigned to_submit, unsigned min_complete);
+void ioring_destroy (void);
+
+#endif /* userprog/ioring.h */
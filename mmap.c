@@ -0,0 +1,160 @@
+#include "vm/mmap.h"
+#include <debug.h>
+#include <list.h>
+#include <round.h>
+#include "filesys/file.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "vm/page.h"
+
+/* A file mapped into a process's address space by mmap().
+
+   Each page of the mapping is a PAGE_MMAP entry in the process's
+   supplemental page table, read from FILE the first time it is
+   touched, so the process accesses the file's data in place
+   rather than through a copy in a buffer of its own.  Pages the
+   process modifies are written back when the mapping goes away,
+   either through munmap() or when the process exits. */
+struct mapping
+  {
+    mapid_t id;                 /* Mapping identifier. */
+    struct file *file;          /* Own handle on the mapped file. */
+    uint8_t *base;              /* First mapped page. */
+    size_t page_cnt;            /* Number of mapped pages. */
+    struct list_elem elem;      /* Element in thread's `mappings'. */
+  };
+
+static struct mapping *mapping_lookup (mapid_t);
+static void mapping_remove (struct mapping *);
+
+/* Maps FILE into the current process's address space at ADDR,
+   which must be page-aligned, nonnull, and not overlap any page
+   already in use, including the region reserved for the stack.
+   The mapping covers the whole file as it is now, with the last
+   page padded with zeroes.  The mapping stays valid after FILE
+   is closed.  Returns the new mapping's identifier, or
+   MAP_FAILED on error. */
+mapid_t
+mmap_map (struct file *file, void *addr)
+{
+  struct thread *t = thread_current ();
+  struct mapping *m;
+  uint8_t *base = addr;
+  off_t length;
+  size_t i;
+
+  if (base == NULL || pg_ofs (base) != 0)
+    return MAP_FAILED;
+  lock_acquire (&filesys_lock);
+  length = file_length (file);
+  lock_release (&filesys_lock);
+  if (length == 0)
+    return MAP_FAILED;
+
+  m = malloc (sizeof *m);
+  if (m == NULL)
+    return MAP_FAILED;
+  m->base = base;
+  m->page_cnt = DIV_ROUND_UP (length, PGSIZE);
+
+  /* The mapping must fit below the stack. */
+  if ((uint32_t) base + m->page_cnt * PGSIZE < (uint32_t) base
+      || base + m->page_cnt * PGSIZE
+         > (uint8_t *) PHYS_BASE - t->stack_limit)
+    {
+      free (m);
+      return MAP_FAILED;
+    }
+
+  lock_acquire (&filesys_lock);
+  m->file = file_reopen (file);
+  lock_release (&filesys_lock);
+  if (m->file == NULL)
+    {
+      free (m);
+      return MAP_FAILED;
+    }
+
+  for (i = 0; i < m->page_cnt; i++)
+    {
+      off_t ofs = i * PGSIZE;
+      uint32_t read_bytes = length - ofs < PGSIZE ? length - ofs : PGSIZE;
+
+      if (!page_add_mmap (base + ofs, m->file, ofs, read_bytes))
+        {
+          /* Undo the pages added so far. */
+          m->page_cnt = i;
+          mapping_remove (m);
+          return MAP_FAILED;
+        }
+    }
+
+  m->id = t->next_mapid++;
+  list_push_back (&t->mappings, &m->elem);
+  return m->id;
+}
+
+/* Unmaps the mapping with identifier ID from the current
+   process's address space, writing modified pages back to the
+   file.  Returns false if there is no such mapping. */
+bool
+mmap_unmap (mapid_t id)
+{
+  struct mapping *m = mapping_lookup (id);
+
+  if (m == NULL)
+    return false;
+  list_remove (&m->elem);
+  mapping_remove (m);
+  return true;
+}
+
+/* Unmaps all of the current process's mappings.  Called when
+   the process exits, while its page table still exists. */
+void
+mmap_destroy (void)
+{
+  struct thread *t = thread_current ();
+
+  while (!list_empty (&t->mappings))
+    {
+      struct list_elem *e = list_pop_front (&t->mappings);
+      mapping_remove (list_entry (e, struct mapping, elem));
+    }
+}
+
+/* Returns the current process's mapping with identifier ID, or
+   a null pointer if there is none. */
+static struct mapping *
+mapping_lookup (mapid_t id)
+{
+  struct thread *t = thread_current ();
+  struct list_elem *e;
+
+  for (e = list_begin (&t->mappings); e != list_end (&t->mappings);
+       e = list_next (e))
+    {
+      struct mapping *m = list_entry (e, struct mapping, elem);
+      if (m->id == id)
+        return m;
+    }
+  return NULL;
+}
+
+/* Removes M's pages from the address space, writing back the
+   ones that were modified, then closes its file and frees it.
+   M must not be in a `mappings' list. */
+static void
+mapping_remove (struct mapping *m)
+{
+  size_t i;
+
+  for (i = 0; i < m->page_cnt; i++)
+    page_remove (m->base + i * PGSIZE);
+  lock_acquire (&filesys_lock);
+  file_close (m->file);
+  lock_release (&filesys_lock);
+  free (m);
+}
@@ -0,0 +1,12 @@
+#ifndef VM_MMAP_H
+#define VM_MMAP_H
+
+#include "userprog/syscall.h"
+
+struct file;
+
+mapid_t mmap_map (struct file *, void *addr);
+bool mmap_unmap (mapid_t);
+void mmap_destroy (void);
+
+#endif /* vm/mmap.h */
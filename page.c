@@ -0,0 +1,682 @@
+#include "vm/page.h"
+#include <debug.h>
+#include <string.h>
+#include "filesys/file.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/pagedir.h"
+#include "userprog/process.h"
+#include "userprog/syscall.h"
+#include "vm/frame.h"
+#include "vm/swap.h"
+
+static hash_hash_func page_hash;
+static hash_less_func page_less;
+static void page_destroy (struct hash_elem *, void *aux);
+static bool page_add (struct page *);
+static bool page_lock (struct thread *);
+static void page_unlock (struct thread *, bool locked);
+static bool page_bring_in (struct page *);
+static bool page_is_shared (const struct page *);
+static bool page_install (struct page *, void *kpage);
+static bool page_read_ahead (struct page *);
+static off_t page_file_io (struct file *, void *, off_t size, off_t ofs,
+                           bool write);
+
+/* Initializes PAGES as an empty supplemental page table.
+   Returns true if successful, false on memory allocation
+   failure. */
+bool
+page_table_init (struct hash *pages)
+{
+  return hash_init (pages, page_hash, page_less, NULL);
+}
+
+/* Frees every entry in PAGES, which must be the current
+   process's table, unmapping each page that is present and
+   dropping its reference to its frame.  Must be called while the
+   process's page directory still exists. */
+void
+page_table_destroy (struct hash *pages)
+{
+  struct thread *t = thread_current ();
+  bool locked = page_lock (t);
+
+  hash_destroy (pages, page_destroy);
+  page_unlock (t, locked);
+}
+
+/* Returns the current process's supplemental page table entry
+   for the page containing ADDR, or a null pointer if there is
+   none. */
+struct page *
+page_lookup (const void *addr)
+{
+  struct thread *t = thread_current ();
+  struct page p;
+  struct hash_elem *e;
+
+  p.upage = pg_round_down (addr);
+  e = hash_find (&t->pages, &p.elem);
+  return e != NULL ? hash_entry (e, struct page, elem) : NULL;
+}
+
+/* Records that UPAGE is to be filled with READ_BYTES bytes read
+   from FILE starting at offset OFS, followed by ZERO_BYTES zero
+   bytes, the first time it is accessed.  Nothing is read now.
+   Returns true if successful, false if UPAGE is already in the
+   table or memory allocation fails. */
+bool
+page_add_file (void *upage, struct file *file, off_t ofs,
+               uint32_t read_bytes, uint32_t zero_bytes, bool writable)
+{
+  struct page *p;
+
+  ASSERT (read_bytes + zero_bytes == PGSIZE);
+
+  p = malloc (sizeof *p);
+  if (p == NULL)
+    return false;
+  p->upage = upage;
+  p->type = PAGE_FILE;
+  p->writable = writable;
+  p->file = file;
+  p->ofs = ofs;
+  p->read_bytes = read_bytes;
+  p->zero_bytes = zero_bytes;
+  return page_add (p);
+}
+
+/* Records that UPAGE is to be mapped to a zeroed page the first
+   time it is accessed.  Returns true if successful, false if
+   UPAGE is already in the table or memory allocation fails. */
+bool
+page_add_zero (void *upage, bool writable)
+{
+  struct page *p = malloc (sizeof *p);
+  if (p == NULL)
+    return false;
+  p->upage = upage;
+  p->type = PAGE_ZERO;
+  p->writable = writable;
+  p->file = NULL;
+  p->ofs = 0;
+  p->read_bytes = 0;
+  p->zero_bytes = PGSIZE;
+  return page_add (p);
+}
+
+/* Records that UPAGE maps READ_BYTES bytes of FILE starting at
+   offset OFS, followed by zeroes, for mmap().  The page is read
+   the first time it is accessed, and written back to FILE when
+   it is removed if the process modified it.  Returns true if
+   successful, false if UPAGE is already in the table or memory
+   allocation fails. */
+bool
+page_add_mmap (void *upage, struct file *file, off_t ofs,
+               uint32_t read_bytes)
+{
+  struct page *p;
+
+  ASSERT (read_bytes > 0 && read_bytes <= PGSIZE);
+
+  p = malloc (sizeof *p);
+  if (p == NULL)
+    return false;
+  p->upage = upage;
+  p->type = PAGE_MMAP;
+  p->writable = true;
+  p->file = file;
+  p->ofs = ofs;
+  p->read_bytes = read_bytes;
+  p->zero_bytes = PGSIZE - read_bytes;
+  return page_add (p);
+}
+
+/* Maps UPAGE to frame KPAGE, which the caller obtained from
+   frame_alloc() and keeps its reference to, so that the kernel
+   and the process share the page.  The page is present from the
+   start and stays that way: the caller's reference keeps the
+   frame table from evicting it, and fork() does not pass it on.
+   Returns true if successful, false if UPAGE is already in the
+   table or memory allocation fails. */
+bool
+page_add_kernel (void *upage, void *kpage)
+{
+  struct thread *t = thread_current ();
+  struct page *p = malloc (sizeof *p);
+  bool locked, success = false;
+
+  if (p == NULL)
+    return false;
+  p->upage = upage;
+  p->type = PAGE_KERNEL;
+  p->writable = true;
+  p->file = NULL;
+  p->ofs = 0;
+  p->read_bytes = 0;
+  p->zero_bytes = 0;
+
+  locked = page_lock (t);
+  if (page_add (p))
+    {
+      frame_ref (kpage);
+      success = page_install (p, kpage);
+      if (!success)
+        {
+          hash_delete (&t->pages, &p->elem);
+          free (p);
+        }
+    }
+  page_unlock (t, locked);
+  return success;
+}
+
+/* Removes UPAGE from the current process's address space,
+   writing it back first if it is a modified mapped-file page.
+   Does nothing if UPAGE is not in the supplemental page
+   table. */
+void
+page_remove (const void *upage)
+{
+  struct thread *t = thread_current ();
+  bool locked = page_lock (t);
+  struct page *p = page_lookup (upage);
+
+  if (p != NULL)
+    {
+      hash_delete (&t->pages, &p->elem);
+      page_destroy (&p->elem, NULL);
+    }
+  page_unlock (t, locked);
+}
+
+/* Maximum number of pages page_load() reads in one go. */
+#define PAGE_READAHEAD_MAX 16
+
+/* Brings in the page containing user address ADDR, which must
+   have an entry in the current process's supplemental page
+   table and must not already be present.  Called by the
+   page-fault handler.  Returns true if successful, false if ADDR
+   is not part of the address space or memory allocation or I/O
+   fails. */
+bool
+page_load (const void *addr)
+{
+  struct thread *t = thread_current ();
+  bool locked = page_lock (t);
+  struct page *p = page_lookup (addr);
+  bool success;
+
+  success = (p != NULL && pagedir_get_page (t->pagedir, p->upage) == NULL
+             && page_bring_in (p));
+  page_unlock (t, locked);
+  return success;
+}
+
+/* Brings in P, which is not present, from wherever its contents
+   are now.  Caller must hold the page lock. */
+static bool
+page_bring_in (struct page *p)
+{
+  uint8_t *kpage;
+
+  /* Evicted pages that had been modified are in swap. */
+  if (p->swap_slot != SWAP_NONE)
+    {
+      kpage = frame_alloc (0);
+      if (kpage == NULL)
+        return false;
+      swap_read (p->swap_slot, kpage);
+      if (!page_install (p, kpage))
+        return false;
+      swap_free (p->swap_slot);
+      p->swap_slot = SWAP_NONE;
+      return true;
+    }
+
+  /* Another process running the same executable may already
+     have this page of its text in memory. */
+  if (page_is_shared (p))
+    {
+      kpage = frame_share_get (file_get_inode (p->file), p->ofs,
+                               p->read_bytes);
+      if (kpage != NULL)
+        return page_install (p, kpage);
+    }
+
+  if (p->type == PAGE_ZERO || p->read_bytes == 0)
+    {
+      /* BSS and stack pages need no I/O at all. */
+      kpage = frame_alloc (PAL_ZERO);
+      if (kpage == NULL)
+        return false;
+      return page_install (p, kpage);
+    }
+
+  return page_read_ahead (p);
+}
+
+/* Extends the current process's stack with the page containing
+   ADDR, if ADDR looks like a stack access given user stack
+   pointer ESP, and brings that page in.  An access counts as a
+   stack access if it lies within the process's stack limit and
+   no more than 32 bytes below ESP, which is as far as PUSHA
+   writes before updating it.  Returns true if successful, false
+   if ADDR is not a stack access or memory is short. */
+bool
+page_grow_stack (const void *addr, const void *esp)
+{
+  uint8_t *upage = pg_round_down (addr);
+
+  if ((const uint8_t *) addr + 32 < (const uint8_t *) esp
+      || !page_add_stack (upage, upage + PGSIZE))
+    return false;
+  return page_load (upage);
+}
+
+/* Adds zero-filled, writable stack pages covering user addresses
+   BOTTOM up to but not including TOP to the current process's
+   supplemental page table, without bringing any of them in.
+   Pages already in the table are left alone.  Returns false if
+   BOTTOM lies beyond the process's stack limit or memory
+   allocation fails. */
+bool
+page_add_stack (const void *bottom, const void *top)
+{
+  struct thread *t = thread_current ();
+  uint8_t *upage;
+
+  ASSERT (top <= PHYS_BASE);
+
+  if ((const uint8_t *) bottom < (uint8_t *) PHYS_BASE - t->stack_limit)
+    return false;
+  for (upage = pg_round_down (bottom); upage < (const uint8_t *) top;
+       upage += PGSIZE)
+    if (page_lookup (upage) == NULL && !page_add_zero (upage, true))
+      return false;
+  return true;
+}
+
+/* Handles a write to the present, read-only page containing user
+   address ADDR.  If the page is writable according to the
+   current process's supplemental page table, then it was shared
+   copy-on-write by fork(): the process gets a private copy of
+   the frame, or simply write access to it if no one else maps it
+   any longer.  Returns true if successful, false if the write
+   is a genuine protection violation or memory is exhausted. */
+bool
+page_copy_on_write (const void *addr)
+{
+  struct thread *t = thread_current ();
+  bool locked = page_lock (t);
+  struct page *p = page_lookup (addr);
+  uint8_t *kpage = NULL, *copy = NULL;
+
+  if (p != NULL && p->writable)
+    kpage = pagedir_get_page (t->pagedir, p->upage);
+  if (kpage != NULL)
+    {
+      if (frame_refcnt (kpage) == 1)
+        copy = kpage;
+      else
+        {
+          copy = frame_alloc (0);
+          if (copy != NULL)
+            memcpy (copy, kpage, PGSIZE);
+        }
+    }
+  if (copy != NULL)
+    {
+      /* Remapping cannot fail: the page table for P already
+         exists.  It loses the dirty bit, so remember it here. */
+      pagedir_clear_page (t->pagedir, p->upage);
+      pagedir_set_page (t->pagedir, p->upage, copy, true);
+      p->dirty = true;
+      if (copy != kpage)
+        {
+          frame_free (kpage, p);
+          frame_attach (copy, p);
+        }
+    }
+  page_unlock (t, locked);
+  return copy != NULL;
+}
+
+/* Makes the current process's address space a copy-on-write
+   clone of PARENT's, which must not run until this returns.
+   Every supplemental page table entry is copied, with pages
+   backed by PARENT's executable redirected to EXEC_FILE, the
+   child's own handle on it.  Every present page is mapped into
+   the current process too, sharing PARENT's frame; writable
+   pages are made read-only in both processes, so that the first
+   write from either side takes a private copy.  Memory-mapped
+   files and pages shared with the kernel are not inherited.
+   Apart from pages the parent has in swap, which the child reads
+   into frames of its own, no page is copied here, so the cost is
+   proportional to the number of pages in the table, not to their
+   contents.  Returns true if successful, false if memory
+   allocation fails. */
+bool
+page_table_fork (struct thread *parent, struct file *exec_file)
+{
+  struct thread *t = thread_current ();
+  struct hash_iterator i;
+  bool locked = page_lock (t);
+  bool success = true;
+
+  lock_acquire (&parent->page_lock);
+  hash_first (&i, &parent->pages);
+  while (success && hash_next (&i))
+    {
+      struct page *pp = hash_entry (hash_cur (&i), struct page, elem);
+      struct page *p;
+      void *kpage;
+
+      if (pp->type == PAGE_MMAP || pp->type == PAGE_KERNEL)
+        continue;
+      p = malloc (sizeof *p);
+      if (p == NULL)
+        {
+          success = false;
+          break;
+        }
+      *p = *pp;
+      if (p->file == parent->exec_file)
+        p->file = exec_file;
+      if (!page_add (p))
+        {
+          success = false;
+          break;
+        }
+
+      /* A swap slot cannot be shared, so copy the page now. */
+      if (pp->swap_slot != SWAP_NONE)
+        {
+          kpage = frame_alloc (0);
+          if (kpage == NULL)
+            success = false;
+          else
+            {
+              swap_read (pp->swap_slot, kpage);
+              p->dirty = true;
+              success = page_install (p, kpage);
+            }
+          continue;
+        }
+
+      kpage = pagedir_get_page (parent->pagedir, pp->upage);
+      if (kpage == NULL)
+        continue;
+      if (!pagedir_set_page (t->pagedir, p->upage, kpage, false))
+        {
+          success = false;
+          break;
+        }
+      frame_ref (kpage);
+      frame_attach (kpage, p);
+      if (pp->writable)
+        {
+          /* Remapping loses the dirty bit, so remember it. */
+          if (pagedir_is_dirty (parent->pagedir, pp->upage))
+            pp->dirty = true;
+          p->dirty = pp->dirty;
+          pagedir_clear_page (parent->pagedir, pp->upage);
+          pagedir_set_page (parent->pagedir, pp->upage, kpage, false);
+        }
+    }
+  lock_release (&parent->page_lock);
+  page_unlock (t, locked);
+  return success;
+}
+
+/* Returns true if P may have to go to swap when it is evicted,
+   because it can be modified and has no file to be written back
+   to. */
+bool
+page_needs_swap (const struct page *p)
+{
+  return p->type != PAGE_MMAP && p->writable;
+}
+
+/* Evicts P, present in frame KPAGE, on behalf of the frame
+   table, which has already taken the frame out of its tables.
+   The caller holds the page lock of P's owner, which need not
+   be the current process.  P is unmapped, then its contents are
+   saved if they cannot be recreated: a modified mapped-file page
+   goes back to its file, and any other modified page to swap
+   slot SLOT, which the caller reserved if page_needs_swap(P).
+   Clean pages are just dropped, to be read or zeroed again on
+   the next fault.  SLOT is released if it turns out not to be
+   needed. */
+void
+page_evict (struct page *p, void *kpage, size_t slot)
+{
+  uint32_t *pd = p->owner->pagedir;
+
+  /* Unmap first, so that the owner cannot modify the page after
+     its dirty bit is read. */
+  pagedir_clear_page (pd, p->upage);
+  if (pagedir_is_dirty (pd, p->upage))
+    p->dirty = true;
+
+  if (p->type == PAGE_MMAP)
+    {
+      if (p->dirty)
+        page_file_io (p->file, kpage, p->read_bytes, p->ofs, true);
+      p->dirty = false;
+    }
+  else if (p->dirty)
+    {
+      ASSERT (slot != SWAP_NONE);
+      swap_write (slot, kpage);
+      p->swap_slot = slot;
+      slot = SWAP_NONE;
+    }
+  if (slot != SWAP_NONE)
+    swap_free (slot);
+}
+
+/* Returns true if P is a read-only file page, whose frame is
+   shared by every process that maps the same part of the same
+   file. */
+static bool
+page_is_shared (const struct page *p)
+{
+  return p->type == PAGE_FILE && !p->writable;
+}
+
+/* Maps P to KPAGE in the current process's page directory.  On
+   failure, drops the reference to KPAGE and returns false. */
+static bool
+page_install (struct page *p, void *kpage)
+{
+  if (!install_page (p->upage, kpage, p->writable))
+    {
+      frame_free (kpage, NULL);
+      return false;
+    }
+  frame_attach (kpage, p);
+  return true;
+}
+
+/* Brings in file page P along with as many of the pages that
+   follow it as the readahead window allows, all with a single
+   read into contiguous frames rather than one small read per
+   page.  The window doubles, up to PAGE_READAHEAD_MAX, each time
+   the process faults on the page just past the last batch, and
+   falls back to a single page as soon as it faults anywhere
+   else.  Following pages are only included while they come from
+   the very next page of the same file and are not yet present.
+   Read-only pages are offered to the shared-frame table as they
+   are installed.  Returns true if P itself was brought in. */
+static bool
+page_read_ahead (struct page *p)
+{
+  struct thread *t = thread_current ();
+  struct page *run[PAGE_READAHEAD_MAX];
+  struct page *last;
+  uint8_t *kpages;
+  uint32_t bytes;
+  size_t cnt, i;
+  bool success = true;
+
+  if (p->upage == t->ra_next && t->ra_pages < PAGE_READAHEAD_MAX)
+    t->ra_pages *= 2;
+  else if (p->upage != t->ra_next)
+    t->ra_pages = 1;
+
+  run[0] = p;
+  for (cnt = 1; cnt < t->ra_pages && run[cnt - 1]->read_bytes == PGSIZE;
+       cnt++)
+    {
+      uint8_t *upage = (uint8_t *) p->upage + cnt * PGSIZE;
+      struct page *next = page_lookup (upage);
+
+      if (next == NULL || next->type != p->type || next->file != p->file
+          || next->ofs != p->ofs + (off_t) (cnt * PGSIZE)
+          || next->read_bytes == 0 || next->swap_slot != SWAP_NONE
+          || pagedir_get_page (t->pagedir, upage) != NULL)
+        break;
+      run[cnt] = next;
+    }
+
+  kpages = frame_alloc_multiple (0, &cnt);
+  if (kpages == NULL)
+    return false;
+  last = run[cnt - 1];
+  bytes = (cnt - 1) * PGSIZE + last->read_bytes;
+  if (page_file_io (p->file, kpages, bytes, p->ofs, false) != (off_t) bytes)
+    {
+      for (i = 0; i < cnt; i++)
+        frame_free (kpages + i * PGSIZE, NULL);
+      return false;
+    }
+  memset (kpages + bytes, 0, last->zero_bytes);
+  t->ra_next = (uint8_t *) p->upage + cnt * PGSIZE;
+
+  for (i = 0; i < cnt; i++)
+    {
+      struct page *q = run[i];
+      void *kpage = kpages + i * PGSIZE;
+
+      if (page_is_shared (q))
+        kpage = frame_share_add (file_get_inode (q->file), q->ofs,
+                                 q->read_bytes, kpage);
+      if (!page_install (q, kpage) && i == 0)
+        success = false;
+    }
+  return success;
+}
+
+/* Inserts P into the current process's supplemental page table.
+   Frees P and returns false if its page is already present. */
+static bool
+page_add (struct page *p)
+{
+  struct thread *t = thread_current ();
+
+  ASSERT (pg_ofs (p->upage) == 0);
+
+  p->owner = t;
+  p->swap_slot = SWAP_NONE;
+  p->dirty = false;
+  if (hash_insert (&t->pages, &p->elem) != NULL)
+    {
+      free (p);
+      return false;
+    }
+  return true;
+}
+
+/* Returns a hash value for page P. */
+static unsigned
+page_hash (const struct hash_elem *p_, void *aux UNUSED)
+{
+  const struct page *p = hash_entry (p_, struct page, elem);
+  return hash_bytes (&p->upage, sizeof p->upage);
+}
+
+/* Returns true if page A precedes page B. */
+static bool
+page_less (const struct hash_elem *a_, const struct hash_elem *b_,
+           void *aux UNUSED)
+{
+  const struct page *a = hash_entry (a_, struct page, elem);
+  const struct page *b = hash_entry (b_, struct page, elem);
+
+  return a->upage < b->upage;
+}
+
+/* Reads or writes SIZE bytes between FILE at offset OFS and
+   BUFFER, as file_read_at() or file_write_at(), holding the file
+   system lock unless the caller already does, as it may when a
+   system call touches user memory that is not yet present.  A
+   write drops FILE from the parsed-executable cache, since it may
+   have rewritten program headers. */
+static off_t
+page_file_io (struct file *file, void *buffer, off_t size, off_t ofs,
+              bool write)
+{
+  bool locked = lock_held_by_current_thread (&filesys_lock);
+  off_t bytes;
+
+  if (!locked)
+    lock_acquire (&filesys_lock);
+  bytes = (write
+           ? file_write_at (file, buffer, size, ofs)
+           : file_read_at (file, buffer, size, ofs));
+  if (write && bytes > 0)
+    elf_cache_invalidate (file_get_inode (file));
+  if (!locked)
+    lock_release (&filesys_lock);
+  return bytes;
+}
+
+/* Acquires T's page lock, unless the current thread already
+   holds it.  Returns true if it had to be acquired, to be passed
+   to page_unlock(). */
+static bool
+page_lock (struct thread *t)
+{
+  if (lock_held_by_current_thread (&t->page_lock))
+    return false;
+  lock_acquire (&t->page_lock);
+  return true;
+}
+
+/* Releases T's page lock if LOCKED, as returned by
+   page_lock(). */
+static void
+page_unlock (struct thread *t, bool locked)
+{
+  if (locked)
+    lock_release (&t->page_lock);
+}
+
+/* Frees supplemental page table entry P_, first unmapping it
+   and dropping its frame reference if it is present, or
+   releasing its swap slot if it is in swap.  A mapped-file page
+   the process has modified is written back to its file first.
+   Caller must hold the page lock. */
+static void
+page_destroy (struct hash_elem *p_, void *aux UNUSED)
+{
+  struct page *p = hash_entry (p_, struct page, elem);
+  uint32_t *pd = thread_current ()->pagedir;
+  void *kpage = pagedir_get_page (pd, p->upage);
+
+  if (kpage != NULL)
+    {
+      if (p->type == PAGE_MMAP
+          && (p->dirty || pagedir_is_dirty (pd, p->upage)))
+        page_file_io (p->file, kpage, p->read_bytes, p->ofs, true);
+      pagedir_clear_page (pd, p->upage);
+      frame_free (kpage, p);
+    }
+  else if (p->swap_slot != SWAP_NONE)
+    swap_free (p->swap_slot);
+  free (p);
+}
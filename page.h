@@ -0,0 +1,77 @@
+#ifndef VM_PAGE_H
+#define VM_PAGE_H
+
+#include <hash.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <list.h>
+#include "filesys/off_t.h"
+
+struct thread;
+
+/* Default limit on the size of a process's stack. */
+#define STACK_LIMIT_DEFAULT (8 * 1024 * 1024)
+
+/* Where a page's initial contents come from. */
+enum page_type
+  {
+    PAGE_FILE,                  /* Read from a file, rest zeroed. */
+    PAGE_ZERO,                  /* All zeroes, no I/O needed. */
+    PAGE_MMAP,                  /* Mapped file, written back if dirty. */
+    PAGE_KERNEL                 /* Shared with the kernel, always present. */
+  };
+
+/* Supplemental page table entry.
+
+   Describes one page of a process's user virtual address space,
+   whether or not it is currently present in the page directory.
+   The page directory says what is mapped right now; this says
+   what should be there, so that the page-fault handler can bring
+   a page in the first time it is touched, and again after it has
+   been evicted.
+
+   Entries are only added and looked up by the process itself.
+   Everything else, including the page directory mappings they
+   describe, is protected by the owner's `page_lock', which the
+   frame table also takes when it evicts one of the owner's
+   pages. */
+struct page
+  {
+    void *upage;                /* User virtual address. */
+    enum page_type type;        /* Source of the page's contents. */
+    bool writable;              /* Writable by the user process? */
+
+    /* PAGE_FILE and PAGE_MMAP only. */
+    struct file *file;          /* File to read from. */
+    off_t ofs;                  /* Offset in FILE. */
+    uint32_t read_bytes;        /* Bytes to read from FILE. */
+    uint32_t zero_bytes;        /* Bytes to zero after those. */
+
+    /* Eviction. */
+    struct thread *owner;       /* Process whose address space this is. */
+    size_t swap_slot;           /* Swap slot holding it, or SWAP_NONE. */
+    bool dirty;                 /* Differs from its original contents? */
+    struct list_elem frame_elem; /* Element in frame's reverse mapping. */
+
+    struct hash_elem elem;      /* Element in thread's `pages'. */
+  };
+
+bool page_table_init (struct hash *);
+void page_table_destroy (struct hash *);
+
+struct page *page_lookup (const void *);
+bool page_add_file (void *upage, struct file *, off_t,
+                    uint32_t read_bytes, uint32_t zero_bytes, bool writable);
+bool page_add_zero (void *upage, bool writable);
+bool page_add_mmap (void *upage, struct file *, off_t, uint32_t read_bytes);
+bool page_add_kernel (void *upage, void *kpage);
+void page_remove (const void *upage);
+bool page_load (const void *);
+bool page_grow_stack (const void *addr, const void *esp);
+bool page_add_stack (const void *bottom, const void *top);
+bool page_copy_on_write (const void *);
+bool page_table_fork (struct thread *parent, struct file *exec_file);
+bool page_needs_swap (const struct page *);
+void page_evict (struct page *, void *kpage, size_t slot);
+
+#endif /* vm/page.h */
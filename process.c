@@ -5,80 +5,172 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include "userprog/fdtable.h"
 #include "userprog/gdt.h"
+#include "userprog/ioring.h"
 #include "userprog/pagedir.h"
+#include "userprog/systrace.h"
 #include "userprog/tss.h"
+#include "userprog/usercopy.h"
+#include "devices/conout.h"
 #include "filesys/directory.h"
 #include "filesys/file.h"
 #include "filesys/filesys.h"
+#include "filesys/inode.h"
 #include "threads/flags.h"
 #include "threads/init.h"
 #include "threads/interrupt.h"
+#include "threads/malloc.h"
 #include "threads/palloc.h"
+#include "threads/synch.h"
 #include "threads/thread.h"
 #include "threads/vaddr.h"
+#include "userprog/syscall.h"
+#include "vm/mmap.h"
+#include "vm/page.h"
+
+/* How a process's exit status reaches its parent.
+
+   Allocated by the parent when it creates the child, and
+   referenced by both: the child through its `exit_record'
+   member, the parent through its `children' list.  Whichever of
+   them lets go last frees it, so a parent can collect a child
+   that has already exited, and a child outliving its parent
+   cleans up after itself. */
+struct exit_record
+  {
+    tid_t tid;                  /* Child's thread id. */
+    int exit_status;            /* Status passed to exit(), or -1. */
+    struct semaphore dead;      /* Upped when the child exits. */
+    struct lock lock;           /* Protects REF_CNT. */
+    int ref_cnt;                /* 2 while both sides hold it. */
+    struct list_elem elem;      /* Element in parent's `children'. */
+  };
+
+/* A parsed command line, laid out exactly as it will appear at
+   the top of the new process's stack:
+
+     return address (0)
+     argc
+     argv, as an offset into IMAGE
+     argv[0] ... argv[argc - 1], as offsets into IMAGE
+     argv[argc] (null)
+     the argument strings, padded to a word boundary
+
+   arguments_init() copies IMAGE onto the stack with a single
+   copy_to_user() and then adds the image's final address to argv
+   and to each argv[] entry. */
+struct arg_block
+  {
+    int argc;                   /* Number of arguments. */
+    size_t size;                /* Bytes in IMAGE. */
+    uint8_t image[];            /* Stack image, as above. */
+  };
+
+/* Passed from process_execute() to the child's start_process(). */
+struct exec_info
+  {
+    const char *file_name;      /* Executable's name. */
+    struct file *file;          /* Executable opened by parent, or null. */
+    const struct arg_block *args; /* Parsed command line. */
+    struct exit_record *exit_record; /* Child's exit record. */
+    struct semaphore loaded;    /* Upped once the load is done. */
+    bool success;               /* Did the load succeed? */
+  };
 
 static thread_func start_process NO_RETURN;
-static bool load (const char *cmdline, void (**eip) (void), void **esp);
+static thread_func fork_process NO_RETURN;
+static bool load (const char *cmdline, struct file *,
+                  void (**eip) (void), void **esp);
+static bool check_executable (struct file *, const char *file_name);
+static struct exit_record *exit_record_create (void);
+static void exit_record_release (struct exit_record *);
 
 /* Starts a new thread running a user program loaded from
-   FILENAME.  The new thread may be scheduled (and may even exit)
-   before process_execute() returns.  Returns the new process's
-   thread id, or TID_ERROR if the thread cannot be created. */
+   FILENAME and waits for it to finish loading.  Returns the new
+   process's thread id, or TID_ERROR if the thread cannot be
+   created or the program cannot be loaded. */
 tid_t
 process_execute (const char *file_name) 
 {
-  char *fn_copy;
-  char *save_ptr;
+  struct arg_block *args;
   tid_t tid;
 
-  /* Make a copy of FILE_NAME.
+  /* Parse FILE_NAME into a block of its own.
      Otherwise there's a race between the caller and load(). */
-  fn_copy = palloc_get_page (0);
-  if (fn_copy == NULL)
+  args = arg_block_create (file_name);
+  if (args == NULL)
     return TID_ERROR;
-  strlcpy (fn_copy, file_name, PGSIZE);
+  tid = process_execute_args (args);
+  free (args);
+  return tid;
+}
+
+/* Starts a new thread running the user program named by ARGS,
+   which the caller keeps and may reuse once this returns, and
+   waits for it to finish loading.  Returns the new process's
+   thread id, or TID_ERROR if the thread cannot be created or the
+   program cannot be loaded. */
+tid_t
+process_execute_args (const struct arg_block *args)
+{
+  struct thread *cur = thread_current ();
+  struct exec_info info;
+  tid_t tid;
+
+  info.file_name = arg_block_name (args);
+  info.file = NULL;
+  info.args = args;
+  info.exit_record = exit_record_create ();
+  if (info.exit_record == NULL)
+    return TID_ERROR;
+  sema_init (&info.loaded, 0);
+  info.success = false;
 
-  /* Create a new thread to execute FILE_NAME. */
-  file_name = strtok_r (file_name, " ", &save_ptr);
-  tid = thread_create (file_name, PRI_DEFAULT, start_process, fn_copy);
+  tid = info.exit_record->tid = thread_create (arg_block_name (args),
+                                               PRI_DEFAULT, start_process,
+                                               &info);
   if (tid == TID_ERROR)
-    palloc_free_page (fn_copy); 
+    {
+      free (info.exit_record);
+      return TID_ERROR;
+    }
+  sema_down (&info.loaded);
+  if (!info.success)
+    {
+      exit_record_release (info.exit_record);
+      return TID_ERROR;
+    }
+  list_push_back (&cur->children, &info.exit_record->elem);
   return tid;
 }
 
 /* A thread function that loads a user process and starts it
    running. */
 static void
-start_process (void *file_name_)
+start_process (void *info_)
 {
-  char *file_name = file_name_;
+  struct exec_info *info = info_;
   struct intr_frame if_;
   bool success;
-  char *arg [LOADER_ARGS_LEN / 2 + 1];
-  char *token;
-  char *save_ptr;
-  int count = 0;
 
-  /* Tokenize the arguments */
-  for (token = strtok_r(file_name, " ", &save_ptr); token != NULL; token = strtok_r(NULL, " ", &save_ptr))
-  {
-	  arg[count++] = token;
-  }
-  int i;
+  thread_current ()->exit_record = info->exit_record;
 
   /* Initialize interrupt frame and load executable. */
   memset (&if_, 0, sizeof if_);
   if_.gs = if_.fs = if_.es = if_.ds = if_.ss = SEL_UDSEG;
   if_.cs = SEL_UCSEG;
   if_.eflags = FLAG_IF | FLAG_MBS;
-  success = load (file_name, &if_.eip, &if_.esp);
+  success = load (info->file_name, info->file, &if_.eip, &if_.esp);
 
   /* Copy the arguments to the process */
-  arguments_init (&arg, count, &if_.esp);
+  if (success)
+    success = arguments_init (info->args, &if_.esp);
 
-  /* If load failed, quit. */
-  palloc_free_page (file_name);
+  /* INFO lives on the parent's stack, so it must not be touched
+     once the parent is released.  If load failed, quit. */
+  info->success = success;
+  sema_up (&info->loaded);
   if (!success) 
     thread_exit ();
 
@@ -92,34 +184,261 @@ start_process (void *file_name_)
   NOT_REACHED ();
 }
 
+/* Starts CNT processes running the executable FILE_NAME, each
+   with the arguments in CMDLINE, and waits for all of them to
+   finish loading.  The executable is opened and its headers
+   parsed once, up front; the children reopen that file and find
+   its segments in the parsed-executable cache, and share its
+   read-only pages.  All the threads are created before waiting
+   on any of them.  Stores the thread ids of the processes that
+   started in TIDS and returns how many there are, or returns -1
+   if FILE_NAME is not a loadable executable, CMDLINE is empty or
+   CNT is negative or more than SPAWN_MANY_MAX. */
+int
+process_spawn_many (const char *file_name, const char *cmdline, int cnt,
+                    tid_t tids[])
+{
+  struct thread *cur = thread_current ();
+  struct exec_info *infos = NULL;
+  struct arg_block *args;
+  struct file *file = NULL;
+  int created, spawned = -1;
+  int i;
+
+  if (cnt < 0 || cnt > SPAWN_MANY_MAX)
+    return -1;
+  args = arg_block_create (cmdline);
+  if (args == NULL)
+    return -1;
+  lock_acquire (&filesys_lock);
+  file = filesys_open (file_name);
+  lock_release (&filesys_lock);
+  if (file == NULL || !check_executable (file, file_name))
+    goto done;
+  infos = malloc (cnt * sizeof *infos);
+  if (infos == NULL && cnt > 0)
+    goto done;
+
+  for (created = 0; created < cnt; created++)
+    {
+      struct exec_info *info = &infos[created];
+      tid_t tid;
+
+      info->file_name = file_name;
+      info->file = file;
+      info->args = args;
+      info->exit_record = exit_record_create ();
+      if (info->exit_record == NULL)
+        break;
+      sema_init (&info->loaded, 0);
+      info->success = false;
+      tid = info->exit_record->tid = thread_create (arg_block_name (args),
+                                                    PRI_DEFAULT,
+                                                    start_process, info);
+      if (tid == TID_ERROR)
+        {
+          free (info->exit_record);
+          break;
+        }
+    }
+
+  spawned = 0;
+  for (i = 0; i < created; i++)
+    {
+      struct exec_info *info = &infos[i];
+
+      sema_down (&info->loaded);
+      if (info->success)
+        {
+          list_push_back (&cur->children, &info->exit_record->elem);
+          tids[spawned++] = info->exit_record->tid;
+        }
+      else
+        exit_record_release (info->exit_record);
+    }
+
+ done:
+  free (infos);
+  lock_acquire (&filesys_lock);
+  file_close (file);
+  lock_release (&filesys_lock);
+  free (args);
+  return spawned;
+}
+
+/* Passed from process_fork() to the child's fork_process(). */
+struct fork_info
+  {
+    struct thread *parent;      /* Process being forked. */
+    struct intr_frame if_;      /* Parent's user registers at the trap. */
+    struct exit_record *exit_record; /* Child's exit record. */
+    struct semaphore done;      /* Upped once the child is set up. */
+    bool success;               /* Did the child set up correctly? */
+  };
+
+/* Creates a child process that is a copy of the current one and
+   resumes from the same point, with user registers taken from
+   F, the interrupt frame of the system call that requested it.
+   The child's address space shares every page with the parent
+   copy-on-write (see page_table_fork()), so no page is copied
+   until one side writes to it.  Returns the child's thread id
+   in the parent; the child sees 0.  Returns TID_ERROR if the
+   child cannot be created. */
+tid_t
+process_fork (const struct intr_frame *f)
+{
+  struct thread *cur = thread_current ();
+  struct fork_info info;
+  tid_t tid;
+
+  info.parent = cur;
+  info.if_ = *f;
+  info.exit_record = exit_record_create ();
+  if (info.exit_record == NULL)
+    return TID_ERROR;
+  sema_init (&info.done, 0);
+  info.success = false;
+
+  tid = info.exit_record->tid = thread_create (thread_name (), PRI_DEFAULT,
+                                               fork_process, &info);
+  if (tid == TID_ERROR)
+    {
+      free (info.exit_record);
+      return TID_ERROR;
+    }
+  sema_down (&info.done);
+  if (!info.success)
+    {
+      exit_record_release (info.exit_record);
+      return TID_ERROR;
+    }
+  list_push_back (&cur->children, &info.exit_record->elem);
+  return tid;
+}
+
+/* A thread function that clones the parent's address space and
+   returns to user mode where the parent trapped into fork(). */
+static void
+fork_process (void *info_)
+{
+  struct fork_info *info = info_;
+  struct thread *parent = info->parent;
+  struct thread *t = thread_current ();
+  struct intr_frame if_ = info->if_;
+  bool success = false;
+
+  t->exit_record = info->exit_record;
+  t->pagedir = pagedir_create ();
+  if (t->pagedir != NULL && !page_table_init (&t->pages))
+    {
+      pagedir_destroy (t->pagedir);
+      t->pagedir = NULL;
+    }
+  if (t->pagedir != NULL)
+    {
+      process_activate ();
+      t->stack_limit = parent->stack_limit;
+      lock_acquire (&filesys_lock);
+      t->exec_file = file_reopen (parent->exec_file);
+      if (t->exec_file != NULL)
+        file_deny_write (t->exec_file);
+      lock_release (&filesys_lock);
+      if (t->exec_file != NULL)
+        success = page_table_fork (parent, t->exec_file);
+      if (success && parent->fds != NULL)
+        {
+          t->fds = fd_table_fork (parent->fds);
+          success = t->fds != NULL;
+        }
+    }
+
+  /* INFO lives on the parent's stack, so it must not be touched
+     once the parent is released. */
+  info->success = success;
+  sema_up (&info->done);
+  if (!success)
+    thread_exit ();
+
+  /* The child's view of fork()'s return value. */
+  if_.eax = 0;
+  asm volatile ("movl %0, %%esp; jmp intr_exit" : : "g" (&if_) : "memory");
+  NOT_REACHED ();
+}
+
 /* Waits for thread TID to die and returns its exit status.  If
    it was terminated by the kernel (i.e. killed due to an
    exception), returns -1.  If TID is invalid or if it was not a
    child of the calling process, or if process_wait() has already
    been successfully called for the given TID, returns -1
-   immediately, without waiting.
-
-   This function will be implemented in problem 2-2.  For now, it
-   does nothing. */
+   immediately, without waiting.  The caller blocks until the
+   child exits. */
 int
-process_wait (tid_t child_tid UNUSED) 
+process_wait (tid_t child_tid) 
 {
-	while(true);
+  struct thread *cur = thread_current ();
+  struct list_elem *e;
+
+  for (e = list_begin (&cur->children); e != list_end (&cur->children);
+       e = list_next (e))
+    {
+      struct exit_record *rec = list_entry (e, struct exit_record, elem);
+      if (rec->tid == child_tid)
+        {
+          int status;
+
+          sema_down (&rec->dead);
+          status = rec->exit_status;
+          list_remove (&rec->elem);
+          exit_record_release (rec);
+          return status;
+        }
+    }
   return -1;
 }
 
+/* Terminates the current process with exit status STATUS, which
+   is reported to its parent. */
+void
+process_terminate (int status)
+{
+  struct thread *cur = thread_current ();
+
+  if (cur->exit_record != NULL)
+    cur->exit_record->exit_status = status;
+  thread_exit ();
+}
+
 /* Free the current process's resources. */
 void
 process_exit (void)
 {
   struct thread *cur = thread_current ();
+  struct list_elem *e;
   uint32_t *pd;
 
+  /* Dump and free system call statistics and trace. */
+  systrace_exit ();
+
+  /* Let go of our children's records, whether or not they have
+     exited. */
+  while (!list_empty (&cur->children))
+    {
+      e = list_pop_front (&cur->children);
+      exit_record_release (list_entry (e, struct exit_record, elem));
+    }
+
   /* Destroy the current process's page directory and switch back
      to the kernel-only page directory. */
   pd = cur->pagedir;
   if (pd != NULL) 
     {
+      /* Finish asynchronous I/O, write back memory-mapped files
+         and release shared frames while the page directory that
+         maps them is still intact. */
+      ioring_destroy ();
+      mmap_destroy ();
+      page_table_destroy (&cur->pages);
+
       /* Correct ordering here is crucial.  We must set
          cur->pagedir to NULL before switching page directories,
          so that a timer interrupt can't switch back to the
@@ -131,6 +450,59 @@ process_exit (void)
       pagedir_activate (NULL);
       pagedir_destroy (pd);
     }
+
+  /* Close the executable only after the page table is gone,
+     since not-yet-loaded pages still refer to it. */
+  fd_table_destroy (cur->fds);
+  cur->fds = NULL;
+  lock_acquire (&filesys_lock);
+  file_close (cur->exec_file);
+  lock_release (&filesys_lock);
+  cur->exec_file = NULL;
+
+  /* Report our exit status to our parent last, so that once
+     wait() returns our mapped files have been written back and
+     our executable may be written again. */
+  if (cur->exit_record != NULL)
+    {
+      conout_flush ();
+      printf ("%s: exit(%d)\n", cur->name, cur->exit_record->exit_status);
+      sema_up (&cur->exit_record->dead);
+      exit_record_release (cur->exit_record);
+      cur->exit_record = NULL;
+    }
+}
+
+/* Returns a new exit record, held by both parent and child, or
+   a null pointer if memory is short.  Until the child calls
+   exit(), its status reads as -1, which is what a process killed
+   by the kernel reports. */
+static struct exit_record *
+exit_record_create (void)
+{
+  struct exit_record *rec = malloc (sizeof *rec);
+  if (rec == NULL)
+    return NULL;
+  rec->tid = TID_ERROR;
+  rec->exit_status = -1;
+  sema_init (&rec->dead, 0);
+  lock_init (&rec->lock);
+  rec->ref_cnt = 2;
+  return rec;
+}
+
+/* Drops one side's hold on REC, freeing it if the other side
+   has already let go. */
+static void
+exit_record_release (struct exit_record *rec)
+{
+  bool last;
+
+  lock_acquire (&rec->lock);
+  last = --rec->ref_cnt == 0;
+  lock_release (&rec->lock);
+  if (last)
+    free (rec);
 }
 
 /* Sets up the CPU for running user code in the current
@@ -145,8 +517,9 @@ process_activate (void)
   pagedir_activate (t->pagedir);
 
   /* Set thread's kernel stack for use in processing
-     interrupts. */
+     interrupts and sysenter. */
   tss_update ();
+  syscall_sysenter_update ();
 }
 
 /* We load ELF binaries.  The following definitions are taken
@@ -212,24 +585,48 @@ struct Elf32_Phdr
 #define PF_W 2          /* Writable. */
 #define PF_R 4          /* Readable. */
 
+/* A loadable segment, parsed and validated from a program
+   header.  load_segment() documents the meaning of each field. */
+struct elf_segment
+  {
+    uint32_t file_page;         /* Page-aligned offset in the file. */
+    uint32_t mem_page;          /* Page-aligned user virtual address. */
+    uint32_t read_bytes;        /* Bytes to read from the file. */
+    uint32_t zero_bytes;        /* Bytes to zero after those. */
+    bool writable;              /* Writable by the user process? */
+  };
+
 static bool setup_stack (void **esp);
+static bool find_segments (struct file *, const char *file_name,
+                           Elf32_Addr *entry, struct elf_segment **,
+                           int *seg_cnt);
 static bool validate_segment (const struct Elf32_Phdr *, struct file *);
+static bool parse_executable (struct file *, const char *file_name,
+                              Elf32_Addr *entry, struct elf_segment **,
+                              int *seg_cnt);
+static bool elf_cache_lookup (struct file *, Elf32_Addr *entry,
+                              struct elf_segment **, int *seg_cnt);
+static void elf_cache_insert (struct file *, Elf32_Addr entry,
+                              const struct elf_segment *, int seg_cnt);
 static bool load_segment (struct file *file, off_t ofs, uint8_t *upage,
                           uint32_t read_bytes, uint32_t zero_bytes,
                           bool writable);
 
 
-/* Loads an ELF executable from FILE_NAME into the current thread.
+/* Loads an ELF executable from FILE_NAME into the current thread,
+   or from a fresh handle on FILE if it is nonnull.
    Stores the executable's entry point into *EIP
    and its initial stack pointer into *ESP.
    Returns true if successful, false otherwise. */
 bool
-load (const char *file_name, void (**eip) (void), void **esp) 
+load (const char *file_name, struct file *exec_file,
+      void (**eip) (void), void **esp) 
 {
   struct thread *t = thread_current ();
-  struct Elf32_Ehdr ehdr;
+  struct elf_segment *segs = NULL;
+  Elf32_Addr entry;
+  int seg_cnt;
   struct file *file = NULL;
-  off_t file_ofs;
   bool success = false;
   int i;
 
@@ -237,106 +634,93 @@ load (const char *file_name, void (**eip) (void), void **esp)
   t->pagedir = pagedir_create ();
   if (t->pagedir == NULL) 
     goto done;
+  if (!page_table_init (&t->pages))
+    {
+      pagedir_destroy (t->pagedir);
+      t->pagedir = NULL;
+      goto done;
+    }
   process_activate ();
 
-  /* Open executable file. */
-  file = filesys_open (file_name);
+  /* Open executable file.  It stays open, and unwritable, for
+     as long as the process runs, because its pages are read in
+     on demand.  process_exit() closes it. */
+  lock_acquire (&filesys_lock);
+  file = exec_file != NULL ? file_reopen (exec_file) : filesys_open (file_name);
+  if (file != NULL)
+    file_deny_write (file);
+  lock_release (&filesys_lock);
   if (file == NULL) 
     {
       printf ("load: %s: open failed\n", file_name);
       goto done; 
     }
+  t->exec_file = file;
 
-  /* Read and verify executable header. */
-  if (file_read (file, &ehdr, sizeof ehdr) != sizeof ehdr
-      || memcmp (ehdr.e_ident, "\177ELF\1\1\1", 7)
-      || ehdr.e_type != 2
-      || ehdr.e_machine != 3
-      || ehdr.e_version != 1
-      || ehdr.e_phentsize != sizeof (struct Elf32_Phdr)
-      || ehdr.e_phnum > 1024) 
-    {
-      printf ("load: %s: error loading executable\n", file_name);
-      goto done; 
-    }
-
-  /* Read program headers. */
-  file_ofs = ehdr.e_phoff;
-  for (i = 0; i < ehdr.e_phnum; i++) 
-    {
-      struct Elf32_Phdr phdr;
+  if (!find_segments (file, file_name, &entry, &segs, &seg_cnt))
+    goto done;
 
-      if (file_ofs < 0 || file_ofs > file_length (file))
-        goto done;
-      file_seek (file, file_ofs);
-
-      if (file_read (file, &phdr, sizeof phdr) != sizeof phdr)
-        goto done;
-      file_ofs += sizeof phdr;
-      switch (phdr.p_type) 
-        {
-        case PT_NULL:
-        case PT_NOTE:
-        case PT_PHDR:
-        case PT_STACK:
-        default:
-          /* Ignore this segment. */
-          break;
-        case PT_DYNAMIC:
-        case PT_INTERP:
-        case PT_SHLIB:
-          goto done;
-        case PT_LOAD:
-          if (validate_segment (&phdr, file)) 
-            {
-              bool writable = (phdr.p_flags & PF_W) != 0;
-              uint32_t file_page = phdr.p_offset & ~PGMASK;
-              uint32_t mem_page = phdr.p_vaddr & ~PGMASK;
-              uint32_t page_offset = phdr.p_vaddr & PGMASK;
-              uint32_t read_bytes, zero_bytes;
-              if (phdr.p_filesz > 0)
-                {
-                  /* Normal segment.
-                     Read initial part from disk and zero the rest. */
-                  read_bytes = page_offset + phdr.p_filesz;
-                  zero_bytes = (ROUND_UP (page_offset + phdr.p_memsz, PGSIZE)
-                                - read_bytes);
-                }
-              else 
-                {
-                  /* Entirely zero.
-                     Don't read anything from disk. */
-                  read_bytes = 0;
-                  zero_bytes = ROUND_UP (page_offset + phdr.p_memsz, PGSIZE);
-                }
-              if (!load_segment (file, file_page, (void *) mem_page,
-                                 read_bytes, zero_bytes, writable))
-                goto done;
-            }
-          else
-            goto done;
-          break;
-        }
-    }
+  for (i = 0; i < seg_cnt; i++)
+    if (!load_segment (file, segs[i].file_page, (void *) segs[i].mem_page,
+                       segs[i].read_bytes, segs[i].zero_bytes,
+                       segs[i].writable))
+      goto done;
 
   /* Set up stack. */
   if (!setup_stack (esp))
     goto done;
 
   /* Start address. */
-  *eip = (void (*) (void)) ehdr.e_entry;
+  *eip = (void (*) (void)) entry;
 
   success = true;
 
  done:
   /* We arrive here whether the load is successful or not. */
-  file_close (file);
+  free (segs);
   return success;
 }
-
+
 /* load() helpers. */
 
-static bool install_page (void *upage, void *kpage, bool writable);
+/* Finds the loadable segments of executable FILE, named
+   FILE_NAME, from the cache if it was parsed recently and by
+   parsing its headers otherwise.  On success, stores the entry
+   point in *ENTRY and a malloc()ed array of *SEG_CNT segments in
+   *SEGS, which the caller must free(), and returns true.
+   Returns false if FILE is not a loadable executable. */
+static bool
+find_segments (struct file *file, const char *file_name, Elf32_Addr *entry,
+               struct elf_segment **segs, int *seg_cnt)
+{
+  bool success = true;
+
+  lock_acquire (&filesys_lock);
+  if (!elf_cache_lookup (file, entry, segs, seg_cnt))
+    {
+      success = parse_executable (file, file_name, entry, segs, seg_cnt);
+      if (success)
+        elf_cache_insert (file, *entry, *segs, *seg_cnt);
+    }
+  lock_release (&filesys_lock);
+  return success;
+}
+
+/* Returns true if FILE, named FILE_NAME, is a loadable
+   executable, leaving its parsed headers in the cache for the
+   processes about to load it. */
+static bool
+check_executable (struct file *file, const char *file_name)
+{
+  struct elf_segment *segs;
+  Elf32_Addr entry;
+  int seg_cnt;
+
+  if (!find_segments (file, file_name, &entry, &segs, &seg_cnt))
+    return false;
+  free (segs);
+  return true;
+}
 
 /* Checks whether PHDR describes a valid, loadable segment in
    FILE and returns true if so, false otherwise. */
@@ -383,7 +767,245 @@ validate_segment (const struct Elf32_Phdr *phdr, struct file *file)
   return true;
 }
 
-/* Loads a segment starting at offset OFS in FILE at address
+/* Reads and verifies FILE's executable header and program
+   headers.  Stores the entry point in *ENTRY and the loadable
+   segments in *SEGS, a malloc()'d array of *SEG_CNT elements
+   that the caller must free.  The program header table is read
+   with a single I/O, not one per header.  Returns true if
+   successful, false if FILE is not a loadable executable. */
+static bool
+parse_executable (struct file *file, const char *file_name,
+                  Elf32_Addr *entry, struct elf_segment **segs,
+                  int *seg_cnt)
+{
+  struct Elf32_Ehdr ehdr;
+  struct Elf32_Phdr *phdrs = NULL;
+  off_t phdrs_size;
+  bool success = false;
+  int i;
+
+  *segs = NULL;
+  *seg_cnt = 0;
+
+  /* Read and verify executable header. */
+  if (file_read_at (file, &ehdr, sizeof ehdr, 0) != sizeof ehdr
+      || memcmp (ehdr.e_ident, "\177ELF\1\1\1", 7)
+      || ehdr.e_type != 2
+      || ehdr.e_machine != 3
+      || ehdr.e_version != 1
+      || ehdr.e_phentsize != sizeof (struct Elf32_Phdr)
+      || ehdr.e_phnum == 0
+      || ehdr.e_phnum > 1024) 
+    {
+      printf ("load: %s: error loading executable\n", file_name);
+      return false;
+    }
+
+  /* Read program headers. */
+  phdrs_size = ehdr.e_phnum * sizeof *phdrs;
+  phdrs = malloc (phdrs_size);
+  *segs = malloc (ehdr.e_phnum * sizeof **segs);
+  if (phdrs == NULL || *segs == NULL)
+    goto done;
+  if (ehdr.e_phoff > (Elf32_Off) file_length (file)
+      || file_read_at (file, phdrs, phdrs_size, ehdr.e_phoff) != phdrs_size)
+    goto done;
+
+  for (i = 0; i < ehdr.e_phnum; i++) 
+    {
+      struct Elf32_Phdr *phdr = &phdrs[i];
+
+      switch (phdr->p_type) 
+        {
+        case PT_NULL:
+        case PT_NOTE:
+        case PT_PHDR:
+        case PT_STACK:
+        default:
+          /* Ignore this segment. */
+          break;
+        case PT_DYNAMIC:
+        case PT_INTERP:
+        case PT_SHLIB:
+          goto done;
+        case PT_LOAD:
+          if (validate_segment (phdr, file)) 
+            {
+              struct elf_segment *seg = &(*segs)[(*seg_cnt)++];
+              uint32_t page_offset = phdr->p_vaddr & PGMASK;
+
+              seg->writable = (phdr->p_flags & PF_W) != 0;
+              seg->file_page = phdr->p_offset & ~PGMASK;
+              seg->mem_page = phdr->p_vaddr & ~PGMASK;
+              if (phdr->p_filesz > 0)
+                {
+                  /* Normal segment.
+                     Read initial part from disk and zero the rest. */
+                  seg->read_bytes = page_offset + phdr->p_filesz;
+                  seg->zero_bytes = (ROUND_UP (page_offset + phdr->p_memsz,
+                                               PGSIZE)
+                                     - seg->read_bytes);
+                }
+              else 
+                {
+                  /* Entirely zero.
+                     Don't read anything from disk. */
+                  seg->read_bytes = 0;
+                  seg->zero_bytes = ROUND_UP (page_offset + phdr->p_memsz,
+                                              PGSIZE);
+                }
+            }
+          else
+            goto done;
+          break;
+        }
+    }
+  *entry = ehdr.e_entry;
+  success = true;
+
+ done:
+  free (phdrs);
+  if (!success)
+    {
+      free (*segs);
+      *segs = NULL;
+    }
+  return success;
+}
+
+/* Cache of parsed executables.
+
+   Executing a program that was executed recently then needs no
+   header I/O or validate_segment() calls at all.  Entries are
+   keyed by inode sector and file length, and
+   elf_cache_invalidate() drops an entry when its file is
+   modified or removed.  The cache is small and only touched for
+   a few hundred bytes at a time, so it is protected by
+   disabling interrupts. */
+#define ELF_CACHE_CNT 8         /* Number of executables remembered. */
+#define ELF_CACHE_SEGS 8        /* Max segments in a cached executable. */
+
+struct elf_cache_entry
+  {
+    bool in_use;                /* Does this entry hold an executable? */
+    block_sector_t inumber;     /* Inode sector of the executable. */
+    off_t length;               /* Its length when it was parsed. */
+    unsigned last_use;          /* Value of elf_cache_clock at last hit. */
+    Elf32_Addr entry;           /* Entry point. */
+    int seg_cnt;                /* Number of loadable segments. */
+    struct elf_segment segs[ELF_CACHE_SEGS];
+  };
+
+static struct elf_cache_entry elf_cache[ELF_CACHE_CNT];
+static unsigned elf_cache_clock;
+
+/* Returns the cache entry for the executable in inode sector
+   INUMBER with the given LENGTH, or a null pointer if there is
+   none.  Interrupts must be off. */
+static struct elf_cache_entry *
+elf_cache_find (block_sector_t inumber, off_t length)
+{
+  int i;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  for (i = 0; i < ELF_CACHE_CNT; i++)
+    if (elf_cache[i].in_use && elf_cache[i].inumber == inumber
+        && elf_cache[i].length == length)
+      return &elf_cache[i];
+  return NULL;
+}
+
+/* Looks up FILE in the cache of parsed executables.  If found,
+   stores its entry point in *ENTRY and a malloc()'d copy of its
+   segments in *SEGS and *SEG_CNT, and returns true.  Otherwise,
+   returns false. */
+static bool
+elf_cache_lookup (struct file *file, Elf32_Addr *entry,
+                  struct elf_segment **segs, int *seg_cnt)
+{
+  block_sector_t inumber = inode_get_inumber (file_get_inode (file));
+  off_t length = file_length (file);
+  struct elf_segment *copy = malloc (ELF_CACHE_SEGS * sizeof *copy);
+  struct elf_cache_entry *e;
+  enum intr_level old_level;
+
+  if (copy == NULL)
+    return false;
+
+  old_level = intr_disable ();
+  e = elf_cache_find (inumber, length);
+  if (e != NULL)
+    {
+      e->last_use = ++elf_cache_clock;
+      *entry = e->entry;
+      *seg_cnt = e->seg_cnt;
+      memcpy (copy, e->segs, e->seg_cnt * sizeof *copy);
+    }
+  intr_set_level (old_level);
+
+  if (e == NULL)
+    {
+      free (copy);
+      return false;
+    }
+  *segs = copy;
+  return true;
+}
+
+/* Remembers the parsed form of FILE, replacing the least
+   recently used entry if the cache is full.  Executables with
+   more than ELF_CACHE_SEGS segments are not cached. */
+static void
+elf_cache_insert (struct file *file, Elf32_Addr entry,
+                  const struct elf_segment *segs, int seg_cnt)
+{
+  block_sector_t inumber = inode_get_inumber (file_get_inode (file));
+  off_t length = file_length (file);
+  struct elf_cache_entry *e;
+  enum intr_level old_level;
+  int i;
+
+  if (seg_cnt > ELF_CACHE_SEGS)
+    return;
+
+  old_level = intr_disable ();
+  e = elf_cache_find (inumber, length);
+  if (e == NULL)
+    {
+      e = &elf_cache[0];
+      for (i = 0; i < ELF_CACHE_CNT && e->in_use; i++)
+        if (!elf_cache[i].in_use || elf_cache[i].last_use < e->last_use)
+          e = &elf_cache[i];
+    }
+  e->in_use = true;
+  e->inumber = inumber;
+  e->length = length;
+  e->last_use = ++elf_cache_clock;
+  e->entry = entry;
+  e->seg_cnt = seg_cnt;
+  memcpy (e->segs, segs, seg_cnt * sizeof *segs);
+  intr_set_level (old_level);
+}
+
+/* Forgets any parsed form of the executable in INODE.  Must be
+   called whenever a file's contents change or it is removed, so
+   that a stale parse is never used. */
+void
+elf_cache_invalidate (struct inode *inode)
+{
+  block_sector_t inumber = inode_get_inumber (inode);
+  enum intr_level old_level;
+  int i;
+
+  old_level = intr_disable ();
+  for (i = 0; i < ELF_CACHE_CNT; i++)
+    if (elf_cache[i].in_use && elf_cache[i].inumber == inumber)
+      elf_cache[i].in_use = false;
+  intr_set_level (old_level);
+}
+
+/* Sets up a segment starting at offset OFS in FILE at address
    UPAGE.  In total, READ_BYTES + ZERO_BYTES bytes of virtual
    memory are initialized, as follows:
 
@@ -395,8 +1017,13 @@ validate_segment (const struct Elf32_Phdr *phdr, struct file *file)
    The pages initialized by this function must be writable by the
    user process if WRITABLE is true, read-only otherwise.
 
+   Nothing is read here.  Each page is only recorded in the
+   supplemental page table, and page_load() fills it in when the
+   process first touches it.  Pages with nothing to read are
+   zero-filled without any I/O.
+
    Return true if successful, false if a memory allocation error
-   or disk read error occurs. */
+   occurs or a page is already part of the address space. */
 static bool
 load_segment (struct file *file, off_t ofs, uint8_t *upage,
               uint32_t read_bytes, uint32_t zero_bytes, bool writable) 
@@ -405,7 +1032,6 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
   ASSERT (pg_ofs (upage) == 0);
   ASSERT (ofs % PGSIZE == 0);
 
-  file_seek (file, ofs);
   while (read_bytes > 0 || zero_bytes > 0) 
     {
       /* Calculate how to fill this page.
@@ -413,53 +1039,37 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
          and zero the final PAGE_ZERO_BYTES bytes. */
       size_t page_read_bytes = read_bytes < PGSIZE ? read_bytes : PGSIZE;
       size_t page_zero_bytes = PGSIZE - page_read_bytes;
+      bool success;
 
-      /* Get a page of memory. */
-      uint8_t *kpage = palloc_get_page (PAL_USER);
-      if (kpage == NULL)
+      /* Record where this page comes from. */
+      if (page_read_bytes == 0)
+        success = page_add_zero (upage, writable);
+      else
+        success = page_add_file (upage, file, ofs, page_read_bytes,
+                                 page_zero_bytes, writable);
+      if (!success)
         return false;
 
-      /* Load this page. */
-      if (file_read (file, kpage, page_read_bytes) != (int) page_read_bytes)
-        {
-          palloc_free_page (kpage);
-          return false; 
-        }
-      memset (kpage + page_read_bytes, 0, page_zero_bytes);
-
-      /* Add the page to the process's address space. */
-      if (!install_page (upage, kpage, writable)) 
-        {
-          palloc_free_page (kpage);
-          return false; 
-        }
-
       /* Advance. */
       read_bytes -= page_read_bytes;
       zero_bytes -= page_zero_bytes;
+      ofs += page_read_bytes;
       upage += PGSIZE;
     }
   return true;
 }
 
-/* Create a minimal stack by mapping a zeroed page at the top of
-   user virtual memory. */
+/* Prepares the stack for a new process: sets its size limit to
+   the default and points *ESP at the top of user virtual memory.
+   Nothing is mapped yet; arguments_init() adds the pages the
+   arguments occupy, and the rest grow on demand as the process
+   faults below them. */
 static bool
 setup_stack (void **esp) 
 {
-  uint8_t *kpage;
-  bool success = false;
-
-  kpage = palloc_get_page (PAL_USER | PAL_ZERO);
-  if (kpage != NULL) 
-    {
-      success = install_page (((uint8_t *) PHYS_BASE) - PGSIZE, kpage, true);
-      if (success)
-        *esp = PHYS_BASE;
-      else
-        palloc_free_page (kpage);
-    }
-  return success;
+  thread_current ()->stack_limit = STACK_LIMIT_DEFAULT;
+  *esp = PHYS_BASE;
+  return true;
 }
 
 /* Adds a mapping from user virtual address UPAGE to kernel
@@ -471,7 +1081,7 @@ setup_stack (void **esp)
    with palloc_get_page().
    Returns true on success, false if UPAGE is already mapped or
    if memory allocation fails. */
-static bool
+bool
 install_page (void *upage, void *kpage, bool writable)
 {
   struct thread *t = thread_current ();
@@ -482,49 +1092,109 @@ install_page (void *upage, void *kpage, bool writable)
           && pagedir_set_page (t->pagedir, upage, kpage, writable));
 }
 
-/*
-  args_[3]
-  args_[2]
-  args_[1]
-  args_[0]
-  word_alignment (x4)
-  positions (args_[4] -> 0)
-  argv
-  argc
-  return address
-*/
-
-void arguments_init (char** args_, const int count, void **esp)
+/* Parses CMDLINE, a sequence of arguments separated by spaces,
+   into a newly allocated argument block sized to fit.  CMDLINE
+   itself is left untouched.  Returns the block, which the caller
+   must free(), or a null pointer if CMDLINE has no arguments or
+   memory is short. */
+struct arg_block *
+arg_block_create (const char *cmdline)
 {
-	uint32_t pos[count];
-	int str_len;
-
-	int i;
-	for (i=count-1; i >= 0; --i)
-	{
-		str_len = strlen(args_[i])+1;
-		*esp -= (str_len);
-		memcpy (*esp, args_[i], str_len);
-		pos[i] = (uint32_t) *esp;
-	}
-
-	*esp = (uint32_t) *esp&0xfffffffc;
-
-	*esp -= 4;
-	*(uint32_t*) (*esp) = 0;
-
-	for ( i = count-1; i >= 0; --i )
-	{
-		*esp -= 4;
-		*(uint32_t*) (*esp) = pos[i];
-	}
-
-	*esp -= 4;
-	*(uint32_t*) (*esp) = (uint32_t) *esp +4;
-
-	*esp -= 4;
-	*(uint32_t*) (*esp) = count;
-
-	*esp -= 4;
-	*(uint32_t*) (*esp) = 0;
-}
\ No newline at end of file
+  struct arg_block *b;
+  uint32_t *words;
+  const char *p;
+  char *str;
+  size_t str_size = 0;
+  size_t hdr_size;
+  int argc = 0;
+
+  /* Count the arguments and the bytes their strings need. */
+  for (p = cmdline; ; )
+    {
+      while (*p == ' ')
+        p++;
+      if (*p == '\0')
+        break;
+      argc++;
+      while (*p != ' ' && *p != '\0')
+        {
+          p++;
+          str_size++;
+        }
+      str_size++;
+    }
+  if (argc == 0)
+    return NULL;
+
+  hdr_size = (argc + 4) * sizeof (uint32_t);
+  b = malloc (sizeof *b + hdr_size + ROUND_UP (str_size, sizeof (uint32_t)));
+  if (b == NULL)
+    return NULL;
+  b->argc = argc;
+  b->size = hdr_size + ROUND_UP (str_size, sizeof (uint32_t));
+
+  /* Lay out the image. */
+  words = (uint32_t *) b->image;
+  words[0] = 0;
+  words[1] = argc;
+  words[2] = 3 * sizeof (uint32_t);
+  words[3 + argc] = 0;
+  str = (char *) b->image + hdr_size;
+  for (p = cmdline, argc = 0; argc < b->argc; argc++)
+    {
+      while (*p == ' ')
+        p++;
+      words[3 + argc] = (uint8_t *) str - b->image;
+      while (*p != ' ' && *p != '\0')
+        *str++ = *p++;
+      *str++ = '\0';
+    }
+  memset (str, 0, b->image + b->size - (uint8_t *) str);
+  return b;
+}
+
+/* Returns the program name in ARGS, its first argument. */
+const char *
+arg_block_name (const struct arg_block *args)
+{
+  const uint32_t *words = (const uint32_t *) args->image;
+  return (const char *) args->image + words[3];
+}
+
+/* Copies the argument block ARGS onto the user stack at *ESP and
+   leaves *ESP pointing to the fake return address at its
+   bottom, which is where a process begins.
+
+   The block's size is checked against the process's stack limit
+   first, and only the pages it occupies are added to the
+   address space.  They are brought in as they are written, with
+   copy_to_user(), so that failing to bring one in makes this
+   function fail instead of faulting in the kernel.  Returns true
+   if successful, false if the arguments do not fit or memory is
+   short. */
+bool
+arguments_init (const struct arg_block *args, void **esp)
+{
+  const uint32_t *words = (const uint32_t *) args->image;
+  uint8_t *top = *esp;
+  uint8_t *sp;
+  int i;
+
+  if (args->size > thread_current ()->stack_limit
+      || !page_add_stack (top - args->size, top))
+    return false;
+
+  sp = top - args->size;
+  if (!copy_to_user (sp, args->image, args->size))
+    return false;
+
+  /* Turn offsets into user addresses: argv, then each argv[i]. */
+  for (i = 2; i < 3 + args->argc; i++)
+    {
+      uint32_t addr = words[i] + (uint32_t) sp;
+      if (!copy_to_user ((uint32_t *) sp + i, &addr, sizeof addr))
+        return false;
+    }
+  *esp = sp;
+  return true;
+}
@@ -3,10 +3,26 @@
 
 #include "threads/thread.h"
 
+struct intr_frame;
+struct arg_block;
+
 tid_t process_execute (const char *file_name);
+tid_t process_execute_args (const struct arg_block *);
+int process_spawn_many (const char *file_name, const char *cmdline, int cnt,
+                        tid_t tids[]);
+tid_t process_fork (const struct intr_frame *);
 int process_wait (tid_t);
+void process_terminate (int status) NO_RETURN;
 void process_exit (void);
 void process_activate (void);
-void arguments_init (char** args_, int count, void **esp);
+
+struct arg_block *arg_block_create (const char *cmdline);
+const char *arg_block_name (const struct arg_block *);
+bool arguments_init (const struct arg_block *, void **esp);
+
+bool install_page (void *upage, void *kpage, bool writable);
+
+struct inode;
+void elf_cache_invalidate (struct inode *);
 
 #endif /* userprog/process.h */
@@ -0,0 +1,103 @@
+#include "vm/swap.h"
+#include <bitmap.h>
+#include <debug.h>
+#include <stdio.h>
+#include "devices/block.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* Number of sectors in a page-sized swap slot. */
+#define SECTORS_PER_SLOT (PGSIZE / BLOCK_SECTOR_SIZE)
+
+/* The swap partition, or null if there is none. */
+static struct block *swap_block;
+
+/* One bit per slot, set if the slot is in use. */
+static struct bitmap *used_slots;
+
+/* Protects USED_SLOTS. */
+static struct lock swap_lock;
+
+/* Statistics. */
+static long long write_cnt;     /* # of pages written to swap. */
+static long long read_cnt;      /* # of pages read from swap. */
+
+/* Finds the swap partition and sets up its slot map.  Without a
+   swap partition, swap_alloc() always fails, so only pages that
+   can be dropped are ever evicted. */
+void
+swap_init (void)
+{
+  lock_init (&swap_lock);
+  swap_block = block_get_role (BLOCK_SWAP);
+  if (swap_block != NULL)
+    {
+      used_slots = bitmap_create (block_size (swap_block)
+                                  / SECTORS_PER_SLOT);
+      if (used_slots == NULL)
+        PANIC ("swap_init: no memory for %"PRDSNu"-sector swap map",
+               block_size (swap_block));
+    }
+}
+
+/* Reserves a free swap slot and returns its index, or SWAP_NONE
+   if swap is full or there is no swap partition. */
+size_t
+swap_alloc (void)
+{
+  size_t slot;
+
+  if (used_slots == NULL)
+    return SWAP_NONE;
+  lock_acquire (&swap_lock);
+  slot = bitmap_scan_and_flip (used_slots, 0, 1, false);
+  lock_release (&swap_lock);
+  return slot != BITMAP_ERROR ? slot : SWAP_NONE;
+}
+
+/* Writes the page at KPAGE to reserved swap slot SLOT. */
+void
+swap_write (size_t slot, const void *kpage)
+{
+  const uint8_t *p = kpage;
+  block_sector_t i;
+
+  ASSERT (bitmap_test (used_slots, slot));
+  for (i = 0; i < SECTORS_PER_SLOT; i++)
+    block_write (swap_block, slot * SECTORS_PER_SLOT + i,
+                 p + i * BLOCK_SECTOR_SIZE);
+  write_cnt++;
+}
+
+/* Reads swap slot SLOT into the page at KPAGE.  The slot stays
+   reserved. */
+void
+swap_read (size_t slot, void *kpage)
+{
+  uint8_t *p = kpage;
+  block_sector_t i;
+
+  ASSERT (bitmap_test (used_slots, slot));
+  for (i = 0; i < SECTORS_PER_SLOT; i++)
+    block_read (swap_block, slot * SECTORS_PER_SLOT + i,
+                p + i * BLOCK_SECTOR_SIZE);
+  read_cnt++;
+}
+
+/* Releases swap slot SLOT. */
+void
+swap_free (size_t slot)
+{
+  lock_acquire (&swap_lock);
+  ASSERT (bitmap_test (used_slots, slot));
+  bitmap_reset (used_slots, slot);
+  lock_release (&swap_lock);
+}
+
+/* Prints swap statistics. */
+void
+swap_print_stats (void)
+{
+  printf ("Swap: %lld pages written, %lld pages read\n",
+          write_cnt, read_cnt);
+}
@@ -1,51 +1,944 @@
 #include "userprog/syscall.h"
+#include <inttypes.h>
+#include <limits.h>
 #include <stdio.h>
+#include <string.h>
 #include <syscall-nr.h>
+#include "devices/conout.h"
+#include "devices/input.h"
+#include "devices/shutdown.h"
+#include "filesys/file.h"
+#include "filesys/filesys.h"
 #include "threads/interrupt.h"
+#include "threads/loader.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
 #include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/fdtable.h"
+#include "userprog/ioring.h"
+#include "userprog/process.h"
+#include "userprog/systrace.h"
+#include "userprog/usercopy.h"
+#include "vm/mmap.h"
+
+/* A system call handler.  ARGS holds the call's arguments,
+   already copied in from the user stack, and F is the caller's
+   interrupt frame.  Returns the value for the caller's eax. */
+typedef uint32_t syscall_func (const uint32_t *args, struct intr_frame *f);
+
+/* A system call table entry. */
+struct syscall
+  {
+    syscall_func *func;         /* Handler. */
+    int argc;                   /* Number of 32-bit arguments. */
+  };
+
+/* Most arguments any system call takes. */
+#define SYSCALL_MAX_ARGS 4
+
+/* Model-specific registers that configure sysenter. */
+#define MSR_SYSENTER_CS 0x174   /* Kernel code segment. */
+#define MSR_SYSENTER_ESP 0x175  /* Kernel stack pointer. */
+#define MSR_SYSENTER_EIP 0x176  /* Kernel entry point. */
+
+/* Writes VALUE to model-specific register MSR. */
+static inline void
+wrmsr (uint32_t msr, uint32_t value)
+{
+  asm volatile ("wrmsr" : : "c" (msr), "a" (value), "d" (0));
+}
+
+static syscall_func sys_null, sys_halt, sys_exit, sys_exec, sys_wait,
+  sys_open, sys_filesize, sys_read, sys_write, sys_seek, sys_tell,
+  sys_close, sys_mmap, sys_munmap, sys_fork, sys_spawn_many, sys_readv,
+  sys_writev, sys_ring_setup, sys_ring_enter, sys_sysstat, sys_systrace,
+  sys_batch, sys_sendfile;
+
+/* System calls, indexed by number.  Numbers without an entry
+   are invalid. */
+static const struct syscall syscall_table[] =
+  {
+    [SYS_NULL] = {sys_null, 0},
+    [SYS_HALT] = {sys_halt, 0},
+    [SYS_EXIT] = {sys_exit, 1},
+    [SYS_EXEC] = {sys_exec, 1},
+    [SYS_WAIT] = {sys_wait, 1},
+    [SYS_OPEN] = {sys_open, 1},
+    [SYS_FILESIZE] = {sys_filesize, 1},
+    [SYS_READ] = {sys_read, 3},
+    [SYS_WRITE] = {sys_write, 3},
+    [SYS_SEEK] = {sys_seek, 2},
+    [SYS_TELL] = {sys_tell, 1},
+    [SYS_CLOSE] = {sys_close, 1},
+    [SYS_MMAP] = {sys_mmap, 2},
+    [SYS_MUNMAP] = {sys_munmap, 1},
+    [SYS_FORK] = {sys_fork, 0},
+    [SYS_SPAWN_MANY] = {sys_spawn_many, 4},
+    [SYS_READV] = {sys_readv, 3},
+    [SYS_WRITEV] = {sys_writev, 3},
+    [SYS_RING_SETUP] = {sys_ring_setup, 3},
+    [SYS_RING_ENTER] = {sys_ring_enter, 2},
+    [SYS_SYSSTAT] = {sys_sysstat, 3},
+    [SYS_SYSTRACE] = {sys_systrace, 1},
+    [SYS_BATCH] = {sys_batch, 2},
+    [SYS_SENDFILE] = {sys_sendfile, 4},
+  };
+
+#define SYSCALL_CNT (sizeof syscall_table / sizeof *syscall_table)
+
+struct lock filesys_lock;
+
+/* Serialize write() and writev() calls to files and to the
+   console, respectively, so that each call's output lands in one
+   piece.  These are held while gathering from user memory, which
+   may fault, and the page fault handler may need filesys_lock,
+   so filesys_lock itself cannot serve. */
+static struct lock file_write_lock;
+static struct lock console_write_lock;
+
+/* If true, log every system call.
+   Controlled by kernel command-line option "-sd". */
+bool syscall_debug;
+
+/* True if the CPU supports sysenter and its MSRs are set up. */
+static bool sysenter_enabled;
 
 static void syscall_handler (struct intr_frame *);  
+static void syscall_dispatch (struct intr_frame *, uint32_t nr,
+                              const uint32_t *args);
+static bool cpu_has_sysenter (void);
+static char *copy_in_string (const char *ustr);
+static struct iovec *copy_in_iovec (const struct iovec *uiov, int iovcnt);
+static bool read_vector (int fd, const struct iovec *, int iovcnt,
+                         int *result);
+static bool write_vector (int fd, const struct iovec *, int iovcnt,
+                          int *result);
 
 void
 syscall_init (void) 
 {
+  ASSERT (SYSCALL_CNT <= SYSCALL_NR_MAX);
+  lock_init (&filesys_lock);
+  lock_init (&file_write_lock);
+  lock_init (&console_write_lock);
+  conout_init ();
+  ioring_init ();
   intr_register_int (0x30, 3, INTR_ON, syscall_handler, "syscall");
+
+  /* Also accept system calls through sysenter, if the CPU has
+     it.  With SYSENTER_CS set to the kernel code segment,
+     sysenter and sysexit derive the kernel stack segment and the
+     user code and stack segments from it, which our GDT layout
+     matches. */
+  if (cpu_has_sysenter ())
+    {
+      extern void sysenter_entry (void);
+
+      wrmsr (MSR_SYSENTER_CS, SEL_KCSEG);
+      wrmsr (MSR_SYSENTER_EIP, (uint32_t) sysenter_entry);
+      sysenter_enabled = true;
+      syscall_sysenter_update ();
+    }
+}
+
+/* Points sysenter at the top of the running thread's kernel
+   stack, the same stack the TSS gives int $0x30.  Called on every
+   context switch, like tss_update(). */
+void
+syscall_sysenter_update (void)
+{
+  if (sysenter_enabled)
+    wrmsr (MSR_SYSENTER_ESP, (uint32_t) thread_current () + PGSIZE);
+}
+
+/* Returns true if the CPU implements sysenter and sysexit. */
+static bool
+cpu_has_sysenter (void)
+{
+  uint32_t eax, ebx, ecx, edx;
+  unsigned family, model, stepping;
+
+  asm ("cpuid" : "=a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx) : "a" (1));
+  family = (eax >> 8) & 0xf;
+  model = (eax >> 4) & 0xf;
+  stepping = eax & 0xf;
+
+  /* Early Pentium Pros set the SEP bit without implementing the
+     instructions. */
+  if (family == 6 && model < 3 && stepping < 3)
+    return false;
+  return (edx & (1u << 11)) != 0;
+}
+
+/* Dispatches the system call whose number and arguments are on
+   the user stack at F->esp through `syscall_table'.  The number
+   and then all of the arguments are each fetched with a single
+   copy_from_user().  A bad stack pointer or an unknown system
+   call number kills the process. */
+static void
+syscall_handler (struct intr_frame *f) 
+{
+  uint32_t args[SYSCALL_MAX_ARGS];
+  const struct syscall *sc;
+  uint32_t nr;
+
+  thread_current ()->user_esp = f->esp;
+  if (!copy_from_user (&nr, f->esp, sizeof nr)
+      || nr >= SYSCALL_CNT || syscall_table[nr].func == NULL)
+    process_terminate (-1);
+  sc = &syscall_table[nr];
+  if (!copy_from_user (args, (uint32_t *) f->esp + 1,
+                       sc->argc * sizeof *args))
+    process_terminate (-1);
+  syscall_dispatch (f, nr, args);
+}
+
+/* Dispatches a system call that entered through sysenter, called
+   from sysenter_entry in sysenter.S with a frame laid out as for
+   int $0x30.  The number is in eax and the arguments in ebx, esi,
+   edi, and ebp, so nothing is read from the user stack.  ecx
+   holds the user stack pointer and edx the return address, which
+   sysenter_entry already placed in F->esp and F->eip. */
+void
+syscall_sysenter_handler (struct intr_frame *f)
+{
+  uint32_t args[SYSCALL_MAX_ARGS] = {f->ebx, f->esi, f->edi, f->ebp};
+  uint32_t nr = f->eax;
+
+  thread_current ()->user_esp = f->esp;
+  if (nr >= SYSCALL_CNT || syscall_table[nr].func == NULL)
+    process_terminate (-1);
+  syscall_dispatch (f, nr, args);
 }
 
+/* Runs system call NR with ARGS on behalf of the process whose
+   frame is F, storing the result in F->eax, and accounts for the
+   time it took. */
 static void
-syscall_handler (struct intr_frame *f UNUSED) 
+syscall_dispatch (struct intr_frame *f, uint32_t nr, const uint32_t *args)
+{
+  uint64_t start, cycles;
+
+  if (syscall_debug)
+    printf ("%s: system call %"PRIu32"\n", thread_name (), nr);
+  start = systrace_cycles ();
+  f->eax = syscall_table[nr].func (args, f);
+  cycles = systrace_cycles () - start;
+
+  /* A batch's calls are each charged as they run, so charging
+     the batch as well would count their cycles twice. */
+  if (nr != SYS_BATCH)
+    systrace_account (nr, cycles);
+  if (thread_current ()->syscall_trace != NULL)
+    systrace_log (nr, args, syscall_table[nr].argc, f->eax, cycles);
+}
+
+/* Copies the array of IOVCNT `struct iovec's at user address
+   UIOV into a new malloc()'d array, which the caller must free.
+   This is the only validation a vector gets: it checks that
+   IOVCNT is in range, that every buffer lies in user space, and
+   that the total length fits in an int, so that the transfer
+   itself only has to deal with faults.  Kills the process if
+   UIOV itself is unreadable.  Returns a null pointer if the
+   vector is invalid or memory is short. */
+static struct iovec *
+copy_in_iovec (const struct iovec *uiov, int iovcnt)
+{
+  struct iovec *iov;
+  size_t total = 0;
+  int i;
+
+  if (iovcnt < 0 || iovcnt > IOV_MAX)
+    return NULL;
+
+  /* Allocate at least one entry, because malloc(0) returns a
+     null pointer, which would read as failure. */
+  iov = malloc ((iovcnt > 0 ? iovcnt : 1) * sizeof *iov);
+  if (iov == NULL)
+    return NULL;
+  if (!copy_from_user (iov, uiov, iovcnt * sizeof *iov))
+    {
+      free (iov);
+      process_terminate (-1);
+    }
+  for (i = 0; i < iovcnt; i++)
+    {
+      total += iov[i].iov_len;
+      if (!user_range_ok (iov[i].iov_base, iov[i].iov_len)
+          || iov[i].iov_len > INT_MAX || total > INT_MAX)
+        {
+          free (iov);
+          return NULL;
+        }
+    }
+  return iov;
+}
+
+/* Returns the total length of the IOVCNT buffers in IOV. */
+static size_t
+iovec_length (const struct iovec *iov, int iovcnt)
+{
+  size_t total = 0;
+  int i;
+
+  for (i = 0; i < iovcnt; i++)
+    total += iov[i].iov_len;
+  return total;
+}
+
+/* Reads from descriptor FD into the IOVCNT user buffers in IOV,
+   a kernel copy of a vector that copy_in_iovec() has checked.
+   Stores the number of bytes read in *RESULT, or -1 if FD is not
+   open.  Returns false if a buffer turns out not to be writable,
+   in which case the caller must kill the process, after freeing
+   anything it allocated.
+
+   The data goes through a kernel bounce buffer, a page at a
+   time, and is scattered across the user buffers with
+   copy_to_user(), so that a bad buffer is caught instead of
+   faulting inside the file system with its lock held.  FD stays
+   locked across the whole vector. */
+static bool
+read_vector (int fd, const struct iovec *iov, int iovcnt, int *result)
 {
-	//Validation
-	void *esp = f->esp;
-	
-	//if (esp == NULL);
-	int *arg;
+  struct fd_table *fds = thread_current ()->fds;
+  size_t size = iovec_length (iov, iovcnt);
+  size_t total = 0, ofs = 0;
+  struct file *file = NULL;
+  uint8_t *buf;
+  int i = 0;
+
+  if (fd != STDIN_FILENO)
+    {
+      file = fd_acquire (fds, fd);
+      if (file == NULL)
+        {
+          *result = -1;
+          return true;
+        }
+    }
+  buf = malloc (size < PGSIZE ? size : PGSIZE);
+  if (buf == NULL && size > 0)
+    {
+      if (file != NULL)
+        fd_release (fds, fd);
+      *result = -1;
+      return true;
+    }
 
-	int *syscall_number = esp;
-	printf ("%d", *syscall_number);
+  while (total < size)
+    {
+      size_t chunk = size - total < PGSIZE ? size - total : PGSIZE;
+      size_t n = chunk, done;
 
-	switch (*syscall_number)
-	{
-	case SYS_EXIT:
-		{
-			arg = esp+4;
-			exit (*arg);
-			break;
-		}
-	case SYS_WRITE:
-		{
-			arg = esp+4;
-			printf ("%d, %x, %d", *(arg), *(arg+1), *(arg+2));
-			write (*(arg), *(arg+1), *(arg+2));
-			break;
-		} 
-	}
+      if (file == NULL)
+        {
+          size_t j;
+          for (j = 0; j < chunk; j++)
+            buf[j] = input_getc ();
+        }
+      else
+        {
+          lock_acquire (&filesys_lock);
+          n = file_read (file, buf, chunk);
+          lock_release (&filesys_lock);
+        }
 
-  printf ("system call!\n");
-  thread_exit ();
+      /* Scatter. */
+      for (done = 0; done < n; )
+        {
+          size_t cnt = iov[i].iov_len - ofs;
+          if (cnt > n - done)
+            cnt = n - done;
+          if (!copy_to_user ((uint8_t *) iov[i].iov_base + ofs,
+                             buf + done, cnt))
+            {
+              free (buf);
+              if (file != NULL)
+                fd_release (fds, fd);
+              return false;
+            }
+          done += cnt;
+          ofs += cnt;
+          if (ofs == iov[i].iov_len)
+            {
+              i++;
+              ofs = 0;
+            }
+        }
+
+      total += n;
+      if (n < chunk)
+        break;
+    }
+  free (buf);
+  if (file != NULL)
+    fd_release (fds, fd);
+  *result = total;
+  return true;
 }
 
+/* Writes the IOVCNT user buffers in IOV, a kernel copy of a
+   vector that copy_in_iovec() has checked, to descriptor FD.
+   Stores the number of bytes written in *RESULT, or -1 if FD is
+   not open.  Returns false if a buffer turns out not to be
+   readable, in which case the caller must kill the process, after
+   freeing anything it allocated.
+
+   The buffers are gathered into a kernel bounce buffer a page at
+   a time with copy_from_user(), as in read_vector().  The whole
+   vector is written under file_write_lock or console_write_lock,
+   so no other write() or writev() lands in the middle of it.
+   That does not hold against sendfile(), asynchronous ring
+   writes, or kernel messages printed directly to the console. */
+static bool
+write_vector (int fd, const struct iovec *iov, int iovcnt, int *result)
+{
+  struct fd_table *fds = thread_current ()->fds;
+  size_t size = iovec_length (iov, iovcnt);
+  size_t total = 0, ofs = 0;
+  struct file *file = NULL;
+  struct lock *write_lock;
+  bool ok = true;
+  uint8_t *buf;
+  int i = 0;
+
+  if (fd != STDOUT_FILENO)
+    {
+      file = fd_acquire (fds, fd);
+      if (file == NULL)
+        {
+          *result = -1;
+          return true;
+        }
+    }
+  buf = malloc (size < PGSIZE ? size : PGSIZE);
+  if (buf == NULL && size > 0)
+    {
+      if (file != NULL)
+        fd_release (fds, fd);
+      *result = -1;
+      return true;
+    }
+
+  write_lock = file != NULL ? &file_write_lock : &console_write_lock;
+  lock_acquire (write_lock);
+  while (total < size)
+    {
+      size_t chunk = size - total < PGSIZE ? size - total : PGSIZE;
+      size_t written = chunk, fill;
 
+      /* Gather. */
+      for (fill = 0; ok && fill < chunk; )
+        {
+          size_t cnt = iov[i].iov_len - ofs;
+          if (cnt > chunk - fill)
+            cnt = chunk - fill;
+          ok = copy_from_user (buf + fill,
+                               (const uint8_t *) iov[i].iov_base + ofs, cnt);
+          fill += cnt;
+          ofs += cnt;
+          if (ofs == iov[i].iov_len)
+            {
+              i++;
+              ofs = 0;
+            }
+        }
+      if (!ok)
+        break;
+
+      if (file == NULL)
+        conout_write (buf, chunk);
+      else
+        {
+          lock_acquire (&filesys_lock);
+          written = file_write (file, buf, chunk);
+          if (written > 0)
+            elf_cache_invalidate (file_get_inode (file));
+          lock_release (&filesys_lock);
+        }
+      total += written;
+      if (written < chunk)
+        break;
+    }
+  lock_release (write_lock);
+  free (buf);
+  if (file != NULL)
+    fd_release (fds, fd);
+  *result = total;
+  return ok;
+}
+
+/* Copies the null-terminated string at user address USTR into
+   a new page, which the caller must free with
+   palloc_free_page().  Kills the process if USTR runs into memory
+   it may not read.  Returns a null pointer if the string does not
+   fit in a page or memory is short. */
+static char *
+copy_in_string (const char *ustr)
+{
+  char *kstr = palloc_get_page (0);
+  int len;
+
+  if (kstr == NULL)
+    return NULL;
+  len = strncpy_from_user (kstr, ustr, PGSIZE);
+  if (len < 0)
+    {
+      palloc_free_page (kstr);
+      process_terminate (-1);
+    }
+  if (len == PGSIZE)
+    {
+      palloc_free_page (kstr);
+      return NULL;
+    }
+  return kstr;
+}
+
+/* System call handlers. */
+
+/* Does nothing, so that timing it measures only the cost of
+   entering and leaving the kernel. */
+static uint32_t
+sys_null (const uint32_t *args UNUSED, struct intr_frame *f UNUSED)
+{
+  return 0;
+}
+
+static uint32_t
+sys_halt (const uint32_t *args UNUSED, struct intr_frame *f UNUSED)
+{
+  conout_flush ();
+  shutdown_power_off ();
+}
+
+static uint32_t
+sys_exit (const uint32_t *args, struct intr_frame *f UNUSED)
+{
+  process_terminate (args[0]);
+}
+
+static uint32_t
+sys_exec (const uint32_t *args, struct intr_frame *f UNUSED)
+{
+  char *cmdline = copy_in_string ((const char *) args[0]);
+  tid_t tid;
+
+  if (cmdline == NULL)
+    return TID_ERROR;
+  tid = process_execute (cmdline);
+  palloc_free_page (cmdline);
+  return tid;
+}
+
+static uint32_t
+sys_wait (const uint32_t *args, struct intr_frame *f UNUSED)
+{
+  return process_wait (args[0]);
+}
+
+/* Opens the file named by ARGS[0] and returns a new file
+   descriptor for it, the lowest one free, or -1 if it cannot be
+   opened.  Descriptors 0 and 1 are the console. */
+static uint32_t
+sys_open (const uint32_t *args, struct intr_frame *f UNUSED)
+{
+  struct thread *cur = thread_current ();
+  struct file *file;
+  char *name;
+  int fd;
+
+  if (cur->fds == NULL)
+    {
+      cur->fds = fd_table_create ();
+      if (cur->fds == NULL)
+        return -1;
+    }
+  name = copy_in_string ((const char *) args[0]);
+  if (name == NULL)
+    return -1;
+  lock_acquire (&filesys_lock);
+  file = filesys_open (name);
+  lock_release (&filesys_lock);
+  palloc_free_page (name);
+  if (file == NULL)
+    return -1;
+
+  fd = fd_install (cur->fds, file);
+  if (fd < 0)
+    {
+      lock_acquire (&filesys_lock);
+      file_close (file);
+      lock_release (&filesys_lock);
+    }
+  return fd;
+}
+
+static uint32_t
+sys_filesize (const uint32_t *args, struct intr_frame *f UNUSED)
+{
+  struct fd_table *fds = thread_current ()->fds;
+  struct file *file = fd_acquire (fds, args[0]);
+  off_t length;
+
+  if (file == NULL)
+    return -1;
+  lock_acquire (&filesys_lock);
+  length = file_length (file);
+  lock_release (&filesys_lock);
+  fd_release (fds, args[0]);
+  return length;
+}
+
+/* Reads up to ARGS[2] bytes from file descriptor ARGS[0] into
+   user buffer ARGS[1].  Returns the number of bytes read, or -1
+   if the descriptor is not open.  Descriptor 0 reads the
+   keyboard. */
+static uint32_t
+sys_read (const uint32_t *args, struct intr_frame *f UNUSED)
+{
+  struct iovec iov = {(void *) args[1], args[2]};
+  int result;
+
+  if (!read_vector (args[0], &iov, 1, &result))
+    process_terminate (-1);
+  return result;
+}
+
+/* Writes ARGS[2] bytes from user buffer ARGS[1] to file
+   descriptor ARGS[0].  Returns the number of bytes written, or
+   -1 if the descriptor is not open. */
+static uint32_t
+sys_write (const uint32_t *args, struct intr_frame *f UNUSED)
+{
+  struct iovec iov = {(void *) args[1], args[2]};
+  int result;
+
+  if (!write_vector (args[0], &iov, 1, &result))
+    process_terminate (-1);
+  return result;
+}
+
+/* Reads from file descriptor ARGS[0] into the ARGS[2] buffers
+   described by the user array of `struct iovec' at ARGS[1],
+   filling each in turn.  Returns the number of bytes read, or -1
+   if the descriptor is not open or the vector is invalid. */
+static uint32_t
+sys_readv (const uint32_t *args, struct intr_frame *f UNUSED)
+{
+  struct iovec *iov = copy_in_iovec ((const struct iovec *) args[1], args[2]);
+  int result;
+  bool ok;
+
+  if (iov == NULL)
+    return -1;
+  ok = read_vector (args[0], iov, args[2], &result);
+  free (iov);
+  if (!ok)
+    process_terminate (-1);
+  return result;
+}
+
+/* Writes the ARGS[2] buffers described by the user array of
+   `struct iovec' at ARGS[1], in order, to file descriptor
+   ARGS[0].  Returns the number of bytes written, or -1 if the
+   descriptor is not open or the vector is invalid. */
+static uint32_t
+sys_writev (const uint32_t *args, struct intr_frame *f UNUSED)
+{
+  struct iovec *iov = copy_in_iovec ((const struct iovec *) args[1], args[2]);
+  int result;
+  bool ok;
+
+  if (iov == NULL)
+    return -1;
+  ok = write_vector (args[0], iov, args[2], &result);
+  free (iov);
+  if (!ok)
+    process_terminate (-1);
+  return result;
+}
+
+/* Sets the position of file descriptor ARGS[0] to ARGS[1]. */
+static uint32_t
+sys_seek (const uint32_t *args, struct intr_frame *f UNUSED)
+{
+  struct fd_table *fds = thread_current ()->fds;
+  struct file *file = fd_acquire (fds, args[0]);
+
+  if (file != NULL)
+    {
+      lock_acquire (&filesys_lock);
+      file_seek (file, args[1]);
+      lock_release (&filesys_lock);
+      fd_release (fds, args[0]);
+    }
+  return 0;
+}
+
+/* Returns the position of file descriptor ARGS[0], or -1 if it
+   is not open. */
+static uint32_t
+sys_tell (const uint32_t *args, struct intr_frame *f UNUSED)
+{
+  struct fd_table *fds = thread_current ()->fds;
+  struct file *file = fd_acquire (fds, args[0]);
+  off_t pos;
+
+  if (file == NULL)
+    return -1;
+  lock_acquire (&filesys_lock);
+  pos = file_tell (file);
+  lock_release (&filesys_lock);
+  fd_release (fds, args[0]);
+  return pos;
+}
+
+static uint32_t
+sys_close (const uint32_t *args, struct intr_frame *f UNUSED)
+{
+  struct file *file = fd_remove (thread_current ()->fds, args[0]);
+
+  if (file != NULL)
+    {
+      lock_acquire (&filesys_lock);
+      file_close (file);
+      lock_release (&filesys_lock);
+    }
+  return 0;
+}
+
+/* Sets up asynchronous I/O rings with ARGS[0] entries in the
+   ARGS[2] bytes at ARGS[1]. */
+static uint32_t
+sys_ring_setup (const uint32_t *args, struct intr_frame *f UNUSED)
+{
+  return ioring_setup (args[0], (void *) args[1], args[2]);
+}
+
+/* Submits up to ARGS[0] queued operations, then waits for ARGS[1]
+   completions. */
+static uint32_t
+sys_ring_enter (const uint32_t *args, struct intr_frame *f UNUSED)
+{
+  return ioring_enter (args[0], args[1]);
+}
+
+/* Copies the system call statistics or trace selected by
+   ARGS[0] into the ARGS[2] bytes at ARGS[1]. */
+static uint32_t
+sys_sysstat (const uint32_t *args, struct intr_frame *f UNUSED)
+{
+  return systrace_read (args[0], (void *) args[1], args[2]);
+}
+
+/* Turns tracing of this process's system calls on or off. */
+static uint32_t
+sys_systrace (const uint32_t *args, struct intr_frame *f UNUSED)
+{
+  return systrace_set (args[0] != 0);
+}
+
+/* Runs the ARGS[1] system calls described by the array of
+   `struct syscall_batch_entry' at ARGS[0], in order, through the
+   same handlers as individual calls, storing each one's return
+   value in its entry.  Stops after the first call that returns
+   -1.  fork() and nested batches may not be batched; they count
+   as failing with -1.  Returns the number of calls that
+   succeeded, or -1 if the count is out of range.
+
+   Entries are copied in and out one at a time rather than
+   through a kernel copy of the whole array, since any call in
+   the batch may kill the process, and a kernel copy would then
+   be leaked. */
+static uint32_t
+sys_batch (const uint32_t *args, struct intr_frame *f)
+{
+  struct syscall_batch_entry *uentries = (void *) args[0];
+  int cnt = args[1];
+  int i;
+
+  if (cnt < 0 || cnt > SYSCALL_BATCH_MAX)
+    return -1;
+
+  for (i = 0; i < cnt; i++)
+    {
+      struct syscall_batch_entry e;
+
+      if (!copy_from_user (&e, &uentries[i], sizeof e))
+        process_terminate (-1);
+      if (e.nr >= SYSCALL_CNT || syscall_table[e.nr].func == NULL
+          || e.nr == SYS_FORK || e.nr == SYS_BATCH)
+        e.ret = -1;
+      else
+        {
+          syscall_dispatch (f, e.nr, e.args);
+          e.ret = f->eax;
+        }
+      if (!copy_to_user (&uentries[i].ret, &e.ret, sizeof e.ret))
+        process_terminate (-1);
+      if (e.ret == -1)
+        break;
+    }
+  return i;
+}
+
+/* Copies up to ARGS[3] bytes from file descriptor ARGS[1] to
+   file descriptor ARGS[0], which may be the console, without
+   passing them through user memory.  If ARGS[2] is a null
+   pointer, reads from ARGS[1]'s current position and advances
+   it.  Otherwise reads from the offset stored at user address
+   ARGS[2], which is updated to follow the last byte read, and
+   leaves ARGS[1]'s position alone.  Returns the number of bytes
+   copied, or -1 if a descriptor is not open or both are the
+   same. */
+static uint32_t
+sys_sendfile (const uint32_t *args, struct intr_frame *f UNUSED)
+{
+  struct fd_table *fds = thread_current ()->fds;
+  int out_fd = args[0], in_fd = args[1];
+  off_t *uofs = (off_t *) args[2];
+  size_t count = args[3];
+  struct file *in = NULL, *out = NULL;
+  size_t total = 0;
+  off_t ofs = 0;
+  uint8_t *buf;
+
+  if (uofs != NULL && !copy_from_user (&ofs, uofs, sizeof ofs))
+    process_terminate (-1);
+  if (in_fd == out_fd)
+    return -1;
+
+  /* Lock the lower-numbered descriptor first, so that two
+     transfers in opposite directions cannot deadlock. */
+  if (out_fd != STDOUT_FILENO && out_fd < in_fd)
+    {
+      out = fd_acquire (fds, out_fd);
+      if (out == NULL)
+        return -1;
+    }
+  in = fd_acquire (fds, in_fd);
+  if (in == NULL)
+    {
+      if (out != NULL)
+        fd_release (fds, out_fd);
+      return -1;
+    }
+  if (out_fd != STDOUT_FILENO && out_fd > in_fd)
+    {
+      out = fd_acquire (fds, out_fd);
+      if (out == NULL)
+        {
+          fd_release (fds, in_fd);
+          return -1;
+        }
+    }
+
+  buf = palloc_get_page (0);
+  while (buf != NULL && total < count)
+    {
+      size_t chunk = count - total < PGSIZE ? count - total : PGSIZE;
+      off_t n, written;
+
+      lock_acquire (&filesys_lock);
+      n = (uofs != NULL
+           ? file_read_at (in, buf, chunk, ofs)
+           : file_read (in, buf, chunk));
+      lock_release (&filesys_lock);
+      if (n <= 0)
+        break;
+
+      written = n;
+      if (out == NULL)
+        conout_write (buf, n);
+      else
+        {
+          lock_acquire (&filesys_lock);
+          written = file_write (out, buf, n);
+          if (written > 0)
+            elf_cache_invalidate (file_get_inode (out));
+          if (written < n && uofs == NULL)
+            file_seek (in, file_tell (in) - (n - written));
+          lock_release (&filesys_lock);
+        }
+      ofs += written;
+      total += written;
+      if (written < n || (size_t) n < chunk)
+        break;
+    }
+  if (buf != NULL)
+    palloc_free_page (buf);
+  fd_release (fds, in_fd);
+  if (out != NULL)
+    fd_release (fds, out_fd);
+
+  if (uofs != NULL && !copy_to_user (uofs, &ofs, sizeof ofs))
+    process_terminate (-1);
+  return buf != NULL ? (int) total : -1;
+}
+
+static uint32_t
+sys_mmap (const uint32_t *args, struct intr_frame *f UNUSED)
+{
+  struct fd_table *fds = thread_current ()->fds;
+  struct file *file = fd_acquire (fds, args[0]);
+  mapid_t id;
+
+  if (file == NULL)
+    return MAP_FAILED;
+  id = mmap_map (file, (void *) args[1]);
+  fd_release (fds, args[0]);
+  return id;
+}
+
+static uint32_t
+sys_munmap (const uint32_t *args, struct intr_frame *f UNUSED)
+{
+  mmap_unmap (args[0]);
+  return 0;
+}
+
+static uint32_t
+sys_fork (const uint32_t *args UNUSED, struct intr_frame *f)
+{
+  return process_fork (f);
+}
+
+static uint32_t
+sys_spawn_many (const uint32_t *args, struct intr_frame *f UNUSED)
+{
+  int cnt = args[2];
+  char *file = NULL, *cmdline = NULL;
+  tid_t *tids = NULL;
+  int spawned = -1;
+
+  /* The cap also keeps the multiplication below from wrapping. */
+  if (cnt < 0 || cnt > SPAWN_MANY_MAX)
+    return -1;
+  file = copy_in_string ((const char *) args[0]);
+  if (file != NULL)
+    cmdline = copy_in_string ((const char *) args[1]);
+  if (cmdline != NULL)
+    tids = malloc (cnt * sizeof *tids);
+  if (tids != NULL || (cmdline != NULL && cnt == 0))
+    spawned = process_spawn_many (file, cmdline, cnt, tids);
+
+  if (cmdline != NULL)
+    palloc_free_page (cmdline);
+  if (file != NULL)
+    palloc_free_page (file);
+  if (spawned > 0
+      && !copy_to_user ((tid_t *) args[3], tids, spawned * sizeof *tids))
+    {
+      free (tids);
+      process_terminate (-1);
+    }
+  free (tids);
+  return spawned;
+}
 
 /* Invokes syscall NUMBER, passing no arguments, and returns the
    return value as an `int'. */
@@ -107,6 +1000,86 @@ syscall_handler (struct intr_frame *f UNUSED)
           retval;                                               \
         })
 
+/* Invokes syscall NUMBER, passing arguments ARG0, ARG1, ARG2,
+   and ARG3, and returns the return value as an `int'. */
+#define syscall4(NUMBER, ARG0, ARG1, ARG2, ARG3)                \
+        ({                                                      \
+          int retval;                                           \
+          asm volatile                                          \
+            ("pushl %[arg3]; pushl %[arg2]; pushl %[arg1]; "    \
+             "pushl %[arg0]; pushl %[number]; int $0x30; "      \
+             "addl $20, %%esp"                                  \
+               : "=a" (retval)                                  \
+               : [number] "i" (NUMBER),                         \
+                 [arg0] "g" (ARG0),                             \
+                 [arg1] "g" (ARG1),                             \
+                 [arg2] "g" (ARG2),                             \
+                 [arg3] "g" (ARG3)                              \
+               : "memory");                                     \
+          retval;                                               \
+        })
+
+/* Invokes syscall NUMBER through sysenter, passing arguments
+   ARG0 through ARG3 in ebx, esi, edi, and ebp, and returns the
+   return value as an `int'.  The kernel returns with sysexit to
+   the address in edx and the stack pointer in ecx, so those two
+   are clobbered; ARG3 travels through ecx on its way into ebp,
+   which is saved around the call since it may be the frame
+   pointer. */
+#define sysenter_syscall4(NUMBER, ARG0, ARG1, ARG2, ARG3)       \
+        ({                                                      \
+          int retval;                                           \
+          int arg3 = (int) (ARG3);                              \
+          asm volatile                                          \
+            ("pushl %%ebp; movl %%ecx, %%ebp; "                 \
+             "movl %%esp, %%ecx; movl $1f, %%edx; "             \
+             "sysenter; 1: popl %%ebp"                          \
+               : "=a" (retval), "+c" (arg3)                     \
+               : "0" (NUMBER),                                  \
+                 "b" (ARG0),                                    \
+                 "S" (ARG1),                                    \
+                 "D" (ARG2)                                     \
+               : "edx", "memory");                              \
+          retval;                                               \
+        })
+#define sysenter_syscall0(NUMBER) \
+        sysenter_syscall4 (NUMBER, 0, 0, 0, 0)
+#define sysenter_syscall1(NUMBER, ARG0) \
+        sysenter_syscall4 (NUMBER, ARG0, 0, 0, 0)
+#define sysenter_syscall2(NUMBER, ARG0, ARG1) \
+        sysenter_syscall4 (NUMBER, ARG0, ARG1, 0, 0)
+#define sysenter_syscall3(NUMBER, ARG0, ARG1, ARG2) \
+        sysenter_syscall4 (NUMBER, ARG0, ARG1, ARG2, 0)
+
+/* Makes a system call that does nothing, through int $0x30 or,
+   if FAST, through sysenter.  Timing a loop of these measures the
+   cost of each entry path.  Defined ahead of the switch below so
+   that the slow path stays int $0x30. */
+void
+null_syscall (bool fast)
+{
+  if (fast)
+    sysenter_syscall0 (SYS_NULL);
+  else
+    syscall0 (SYS_NULL);
+}
+
+/* Programs built with SYSCALL_SYSENTER defined make every system
+   call below through sysenter.  The CPU must support it; see
+   syscall_init(). */
+#ifdef SYSCALL_SYSENTER
+#undef syscall0
+#undef syscall1
+#undef syscall2
+#undef syscall3
+#undef syscall4
+#define syscall0 sysenter_syscall0
+#define syscall1 sysenter_syscall1
+#define syscall2 sysenter_syscall2
+#define syscall3 sysenter_syscall3
+#define syscall4 sysenter_syscall4
+#endif
+
 void
 halt (void) 
 {
@@ -228,3 +1201,63 @@ inumber (int fd)
 {
   return syscall1 (SYS_INUMBER, fd);
 }
+
+pid_t
+fork (void)
+{
+  return (pid_t) syscall0 (SYS_FORK);
+}
+
+int
+spawn_many (const char *file, const char *cmdline, int cnt, pid_t pids[])
+{
+  return syscall4 (SYS_SPAWN_MANY, file, cmdline, cnt, pids);
+}
+
+int
+readv (int fd, const struct iovec *iov, int iovcnt)
+{
+  return syscall3 (SYS_READV, fd, iov, iovcnt);
+}
+
+int
+writev (int fd, const struct iovec *iov, int iovcnt)
+{
+  return syscall3 (SYS_WRITEV, fd, iov, iovcnt);
+}
+
+int
+ring_setup (unsigned entries, void *addr, unsigned size)
+{
+  return syscall3 (SYS_RING_SETUP, entries, addr, size);
+}
+
+int
+ring_enter (unsigned to_submit, unsigned min_complete)
+{
+  return syscall2 (SYS_RING_ENTER, to_submit, min_complete);
+}
+
+int
+sysstat (int what, void *buffer, unsigned size)
+{
+  return syscall3 (SYS_SYSSTAT, what, buffer, size);
+}
+
+bool
+systrace (bool enable)
+{
+  return syscall1 (SYS_SYSTRACE, enable);
+}
+
+int
+syscall_batch (struct syscall_batch_entry *entries, int cnt)
+{
+  return syscall2 (SYS_BATCH, entries, cnt);
+}
+
+int
+sendfile (int out_fd, int in_fd, int *offset, unsigned count)
+{
+  return syscall4 (SYS_SENDFILE, out_fd, in_fd, offset, count);
+}
@@ -1,10 +1,25 @@
 #ifndef USERPROG_SYSCALL_H
 #define USERPROG_SYSCALL_H
 
-void syscall_init (void);
-
 #include <stdbool.h>
+#include <stddef.h>
 #include <debug.h>
+#include <syscall-nr.h>
+
+void syscall_init (void);
+
+/* Serializes access to the file system, which is not safe to
+   use from more than one thread at a time. */
+struct lock;
+extern struct lock filesys_lock;
+
+void syscall_sysenter_update (void);
+struct intr_frame;
+void syscall_sysenter_handler (struct intr_frame *);
+
+/* If true, log every system call.
+   Controlled by kernel command-line option "-sd". */
+extern bool syscall_debug;
 
 /* Process identifier. */
 typedef int pid_t;
@@ -14,9 +29,146 @@ typedef int pid_t;
 typedef int mapid_t;
 #define MAP_FAILED ((mapid_t) -1)
 
+/* Most processes one spawn_many() may start. */
+#define SPAWN_MANY_MAX 64
+
+/* One buffer of a vector passed to readv() or writev(). */
+struct iovec
+  {
+    void *iov_base;             /* Start of buffer. */
+    size_t iov_len;             /* Length of buffer in bytes. */
+  };
+
+/* Maximum number of buffers in one readv() or writev(). */
+#define IOV_MAX 64
+
+/* Asynchronous I/O rings, set up by ring_setup().
+
+   The rings live in a region of memory shared between the
+   process and the kernel.  It starts with a `struct ring_header',
+   followed at RING_SQ_OFS by the submission queue, an array of
+   ENTRIES `struct ring_sqe's, and then at RING_CQ_OFS(ENTRIES)
+   by the completion queue, an array of ENTRIES `struct
+   ring_cqe's.  The rest of the region, from
+   RING_DATA_OFS(ENTRIES), is free for buffers.  Every buffer and
+   file name an entry refers to must lie inside the region.
+
+   Each queue is indexed by free-running counters, taken modulo
+   ENTRIES.  The process fills in submission entries at sq_tail
+   and advances it; ring_enter() consumes them from sq_head.  The
+   kernel posts a completion at cq_tail as each operation
+   finishes; the process consumes completions from cq_head.
+   Operations may complete in any order. */
+struct ring_header
+  {
+    unsigned sq_head;           /* Advanced by the kernel. */
+    unsigned sq_tail;           /* Advanced by the process. */
+    unsigned cq_head;           /* Advanced by the process. */
+    unsigned cq_tail;           /* Advanced by the kernel. */
+    unsigned entries;           /* Entries in each queue. */
+  };
+
+/* Submission queue entry. */
+struct ring_sqe
+  {
+    int opcode;                 /* RING_OP_*. */
+    int fd;                     /* Descriptor, for all but RING_OP_OPEN. */
+    void *buf;                  /* Buffer, or file name for RING_OP_OPEN. */
+    unsigned len;               /* Length of BUF. */
+    unsigned user_data;         /* Copied to the completion. */
+    unsigned reserved[3];       /* Pads entries to 32 bytes. */
+  };
+
+/* Completion queue entry. */
+struct ring_cqe
+  {
+    unsigned user_data;         /* From the submission. */
+    int result;                 /* As the synchronous system call. */
+  };
+
+/* Operations, each behaving like the system call of the same
+   name. */
+enum
+  {
+    RING_OP_READ,
+    RING_OP_WRITE,
+    RING_OP_OPEN,
+    RING_OP_CLOSE
+  };
+
+#define RING_MAX_ENTRIES 256    /* Most entries in each queue. */
+#define RING_MAX_SIZE (64 * 4096) /* Largest ring region, in bytes. */
+#define RING_SQ_OFS 64
+#define RING_CQ_OFS(ENTRIES) \
+        (RING_SQ_OFS + (ENTRIES) * sizeof (struct ring_sqe))
+#define RING_DATA_OFS(ENTRIES) \
+        (RING_CQ_OFS (ENTRIES) + (ENTRIES) * sizeof (struct ring_cqe))
+
+/* System call statistics, as read by sysstat().  Latencies are
+   in CPU cycles.  Entry B of a histogram counts calls that took
+   at least 2**B cycles but fewer than 2**(B+1). */
+#define SYSCALL_NR_MAX 32       /* System call numbers covered. */
+#define SYSCALL_HIST_BUCKETS 32 /* Buckets per histogram. */
+
+struct syscall_stats
+  {
+    unsigned long long count[SYSCALL_NR_MAX];   /* Calls. */
+    unsigned long long cycles[SYSCALL_NR_MAX];  /* Total latency. */
+    unsigned hist[SYSCALL_NR_MAX][SYSCALL_HIST_BUCKETS]; /* Latencies. */
+  };
+
+/* One traced system call, as read by sysstat(). */
+struct syscall_trace_entry
+  {
+    int tid;                    /* Calling thread. */
+    unsigned nr;                /* System call number. */
+    unsigned args[4];           /* Arguments; unused ones are 0. */
+    unsigned ret;               /* Return value. */
+    unsigned long long cycles;  /* Latency. */
+  };
+
+/* Number of system calls a process's trace remembers. */
+#define SYSCALL_TRACE_SIZE 128
+
+/* What sysstat() reads. */
+enum
+  {
+    SYSSTAT_GLOBAL,             /* `struct syscall_stats', all processes. */
+    SYSSTAT_PROCESS,            /* `struct syscall_stats', this process. */
+    SYSSTAT_TRACE               /* `struct syscall_trace_entry's, oldest
+                                   first. */
+  };
+
+/* One system call in a syscall_batch(). */
+struct syscall_batch_entry
+  {
+    unsigned nr;                /* System call number. */
+    unsigned args[4];           /* Arguments; extra ones are ignored. */
+    int ret;                    /* Set to the return value. */
+  };
+
+/* Most entries in one syscall_batch(). */
+#define SYSCALL_BATCH_MAX 64
+
 /* Maximum characters in a filename written by readdir(). */
 #define READDIR_MAX_LEN 14
 
+/* System calls beyond those numbered in <syscall-nr.h>. */
+enum
+  {
+    SYS_FORK = SYS_INUMBER + 1, /* Duplicate the current process. */
+    SYS_SPAWN_MANY,             /* Start many copies of a program. */
+    SYS_NULL,                   /* Do nothing, for timing entry. */
+    SYS_READV,                  /* Read into several buffers. */
+    SYS_WRITEV,                 /* Write from several buffers. */
+    SYS_RING_SETUP,             /* Create asynchronous I/O rings. */
+    SYS_RING_ENTER,             /* Submit to and wait on the rings. */
+    SYS_SYSSTAT,                /* Read system call statistics. */
+    SYS_SYSTRACE,               /* Turn system call tracing on or off. */
+    SYS_BATCH,                  /* Run several system calls at once. */
+    SYS_SENDFILE                /* Copy between files in the kernel. */
+  };
+
 /* Typical return values from main() and arguments to exit(). */
 #define EXIT_SUCCESS 0          /* Successful execution. */
 #define EXIT_FAILURE 1          /* Unsuccessful execution. */
@@ -47,4 +199,17 @@ bool readdir (int fd, char name[READDIR_MAX_LEN + 1]);
 bool isdir (int fd);
 int inumber (int fd);
 
+/* Extensions. */
+pid_t fork (void);
+int spawn_many (const char *file, const char *cmdline, int cnt, pid_t pids[]);
+void null_syscall (bool fast);
+int readv (int fd, const struct iovec *, int iovcnt);
+int writev (int fd, const struct iovec *, int iovcnt);
+int ring_setup (unsigned entries, void *addr, unsigned size);
+int ring_enter (unsigned to_submit, unsigned min_complete);
+int sysstat (int what, void *buffer, unsigned size);
+bool systrace (bool enable);
+int syscall_batch (struct syscall_batch_entry *, int cnt);
+int sendfile (int out_fd, int in_fd, int *offset, unsigned count);
+
 #endif /* userprog/syscall.h */
@@ -0,0 +1,240 @@
+#include "userprog/systrace.h"
+#include <debug.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/conout.h"
+#include "threads/interrupt.h"
+#include "threads/malloc.h"
+#include "threads/thread.h"
+#include "userprog/process.h"
+#include "userprog/syscall.h"
+#include "userprog/usercopy.h"
+
+/* System call statistics and tracing.
+
+   syscall_dispatch() times every system call with the cycle
+   counter and charges it to both the global statistics and the
+   calling process's own, which are allocated with its first
+   system call.  A process may also turn on tracing, which
+   records each of its calls, with arguments, return value and
+   latency, in a ring of the last SYSCALL_TRACE_SIZE calls.  The
+   dispatcher tests the process's `syscall_trace' pointer once
+   per call, so tracing costs nothing more while it is off.
+
+   A process's statistics and trace belong to it alone.  The
+   global statistics are updated with interrupts off. */
+struct systrace
+  {
+    struct syscall_trace_entry entries[SYSCALL_TRACE_SIZE];
+    unsigned long long cnt;     /* Calls ever logged. */
+  };
+
+static struct syscall_stats global_stats;
+
+static void stats_add (struct syscall_stats *, uint32_t nr, uint64_t cycles);
+static void stats_print (const char *who, const struct syscall_stats *);
+
+/* Charges a call to system call NR that took CYCLES cycles to
+   the global statistics and the current process's. */
+void
+systrace_account (uint32_t nr, uint64_t cycles)
+{
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+
+  ASSERT (nr < SYSCALL_NR_MAX);
+
+  if (cur->syscall_stats == NULL)
+    cur->syscall_stats = calloc (1, sizeof *cur->syscall_stats);
+  if (cur->syscall_stats != NULL)
+    stats_add (cur->syscall_stats, nr, cycles);
+
+  old_level = intr_disable ();
+  stats_add (&global_stats, nr, cycles);
+  intr_set_level (old_level);
+}
+
+/* Records a call to system call NR with ARGC arguments ARGS,
+   which returned RET after CYCLES cycles, in the current
+   process's trace, which must be enabled. */
+void
+systrace_log (uint32_t nr, const uint32_t *args, int argc, uint32_t ret,
+              uint64_t cycles)
+{
+  struct systrace *t = thread_current ()->syscall_trace;
+  struct syscall_trace_entry *e = &t->entries[t->cnt++ % SYSCALL_TRACE_SIZE];
+  int i;
+
+  e->tid = thread_tid ();
+  e->nr = nr;
+  for (i = 0; i < 4; i++)
+    e->args[i] = i < argc ? args[i] : 0;
+  e->ret = ret;
+  e->cycles = cycles;
+}
+
+/* Turns tracing of the current process's system calls on or off,
+   per ENABLE.  Turning it off discards the trace.  Returns false
+   if memory is short, true otherwise. */
+bool
+systrace_set (bool enable)
+{
+  struct thread *cur = thread_current ();
+
+  if (enable && cur->syscall_trace == NULL)
+    {
+      cur->syscall_trace = malloc (sizeof *cur->syscall_trace);
+      if (cur->syscall_trace == NULL)
+        return false;
+      cur->syscall_trace->cnt = 0;
+    }
+  else if (!enable)
+    {
+      free (cur->syscall_trace);
+      cur->syscall_trace = NULL;
+    }
+  return true;
+}
+
+/* Copies the statistics or trace selected by WHAT, one of the
+   SYSSTAT_* values, to the SIZE bytes at user address UBUF.
+   Returns the number of bytes copied, or -1 if WHAT is invalid
+   or memory is short.  Kills the process if UBUF is bad. */
+int
+systrace_read (int what, void *ubuf, size_t size)
+{
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+  void *copy;
+  size_t len;
+
+  switch (what)
+    {
+    case SYSSTAT_GLOBAL:
+    case SYSSTAT_PROCESS:
+      {
+        struct syscall_stats *s = malloc (sizeof *s);
+        if (s == NULL)
+          return -1;
+        if (what == SYSSTAT_PROCESS)
+          {
+            if (cur->syscall_stats != NULL)
+              *s = *cur->syscall_stats;
+            else
+              memset (s, 0, sizeof *s);
+          }
+        else
+          {
+            old_level = intr_disable ();
+            *s = global_stats;
+            intr_set_level (old_level);
+          }
+        copy = s;
+        len = sizeof *s;
+      }
+      break;
+
+    case SYSSTAT_TRACE:
+      {
+        struct systrace *t = cur->syscall_trace;
+        struct syscall_trace_entry *e;
+        unsigned long long first;
+        size_t cnt, i;
+
+        cnt = t == NULL ? 0 : t->cnt < SYSCALL_TRACE_SIZE ? t->cnt
+                                                           : SYSCALL_TRACE_SIZE;
+        if (cnt > size / sizeof *e)
+          cnt = size / sizeof *e;
+        if (cnt == 0)
+          return 0;
+        e = malloc (cnt * sizeof *e);
+        if (e == NULL)
+          return -1;
+        first = t->cnt - cnt;
+        for (i = 0; i < cnt; i++)
+          e[i] = t->entries[(first + i) % SYSCALL_TRACE_SIZE];
+        copy = e;
+        len = cnt * sizeof *e;
+      }
+      break;
+
+    default:
+      return -1;
+    }
+
+  if (len > size)
+    len = size;
+  if (!copy_to_user (ubuf, copy, len))
+    {
+      free (copy);
+      process_terminate (-1);
+    }
+  free (copy);
+  return len;
+}
+
+/* Frees the current process's statistics and trace, printing
+   the statistics first if system call logging is on, and the
+   trace if there is one.  Called when a process exits. */
+void
+systrace_exit (void)
+{
+  struct thread *cur = thread_current ();
+  struct systrace *t = cur->syscall_trace;
+
+  if ((syscall_debug && cur->syscall_stats != NULL) || t != NULL)
+    conout_flush ();
+  if (syscall_debug && cur->syscall_stats != NULL)
+    stats_print (cur->name, cur->syscall_stats);
+  if (t != NULL)
+    {
+      unsigned long long i = t->cnt > SYSCALL_TRACE_SIZE
+                             ? t->cnt - SYSCALL_TRACE_SIZE : 0;
+      for (; i < t->cnt; i++)
+        {
+          const struct syscall_trace_entry *e
+            = &t->entries[i % SYSCALL_TRACE_SIZE];
+          printf ("%s: trace: tid %d, system call %u (%#x, %#x, %#x, %#x)"
+                  " = %#x, %llu cycles\n",
+                  cur->name, e->tid, e->nr, e->args[0], e->args[1],
+                  e->args[2], e->args[3], e->ret, e->cycles);
+        }
+    }
+
+  free (cur->syscall_stats);
+  cur->syscall_stats = NULL;
+  free (t);
+  cur->syscall_trace = NULL;
+}
+
+/* Prints the global system call statistics. */
+void
+systrace_print_stats (void)
+{
+  stats_print ("System calls", &global_stats);
+}
+
+/* Adds a call to system call NR that took CYCLES cycles to S. */
+static void
+stats_add (struct syscall_stats *s, uint32_t nr, uint64_t cycles)
+{
+  int bucket = (cycles >> 32 != 0 ? SYSCALL_HIST_BUCKETS - 1
+                : 31 - __builtin_clz ((uint32_t) cycles | 1));
+
+  s->count[nr]++;
+  s->cycles[nr] += cycles;
+  s->hist[nr][bucket]++;
+}
+
+/* Prints a line for each system call with calls in S, labeled
+   with WHO. */
+static void
+stats_print (const char *who, const struct syscall_stats *s)
+{
+  int nr;
+
+  for (nr = 0; nr < SYSCALL_NR_MAX; nr++)
+    if (s->count[nr] > 0)
+      printf ("%s: system call %d: %llu calls, %llu cycles average\n",
+              who, nr, s->count[nr], s->cycles[nr] / s->count[nr]);
+}
@@ -0,0 +1,25 @@
+#ifndef USERPROG_SYSTRACE_H
+#define USERPROG_SYSTRACE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Returns the CPU's cycle counter. */
+static inline uint64_t
+systrace_cycles (void)
+{
+  uint64_t tsc;
+  asm volatile ("rdtsc" : "=A" (tsc));
+  return tsc;
+}
+
+void systrace_account (uint32_t nr, uint64_t cycles);
+void systrace_log (uint32_t nr, const uint32_t *args, int argc,
+                   uint32_t ret, uint64_t cycles);
+bool systrace_set (bool enable);
+int systrace_read (int what, void *ubuf, size_t size);
+void systrace_exit (void);
+void systrace_print_stats (void);
+
+#endif /* userprog/systrace.h */
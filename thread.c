@@ -11,6 +11,7 @@
 #include "threads/switch.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
+#include "threads/zpool.h"
 #ifdef USERPROG
 #include "userprog/process.h"
 #endif
@@ -51,6 +52,8 @@ struct kernel_thread_frame
 static long long idle_ticks;    /* # of timer ticks spent idle. */
 static long long kernel_ticks;  /* # of timer ticks in kernel threads. */
 static long long user_ticks;    /* # of timer ticks in user programs. */
+static long long wakeup_cnt;    /* # of sleeping threads woken. */
+static long long coalesced_cnt; /* # of wakeups batched before deadline. */
 
 /* Scheduling. */
 #define TIME_SLICE 4            /* # of timer ticks to give each thread. */
@@ -153,6 +156,7 @@ thread_print_stats (void)
 {
   printf ("Thread: %lld idle ticks, %lld kernel ticks, %lld user ticks\n",
           idle_ticks, kernel_ticks, user_ticks);
+  printf ("Sleep: %lld wakeups, %lld coalesced\n", wakeup_cnt, coalesced_cnt);
 }
 
 /* Creates a new kernel thread named NAME with the given initial
@@ -184,13 +188,14 @@ thread_create (const char *name, int priority,
   ASSERT (function != NULL);
 
   /* Allocate thread. */
-  t = palloc_get_page (PAL_ZERO);
+  t = zpool_get_page (PAL_ZERO);
   if (t == NULL)
     return TID_ERROR;
 
   /* Initialize thread. */
   init_thread (t, name, priority);
   tid = t->tid = allocate_tid ();
+  t->timer_slack = thread_current ()->timer_slack;
   /* Prepare thread for first run by initializing its stack.
      Do this atomically so intermediate values for the 'stack' 
      member cannot be observed. */
@@ -344,14 +349,34 @@ thread_sleep_yield (int64_t ticks)
   old_level = intr_disable ();
   if (cur != idle_thread) 
   {
-	  new_push_thread (&sleep_list, &cur->elem);
 	  cur->wait_time = ticks;
+	  cur->wait_slack = cur->timer_slack;
+	  new_push_thread (&sleep_list, &cur->elem);
   }
   cur->status = THREAD_READY;
   schedule ();
   intr_set_level (old_level);
 }
 
+/* Sets the current thread's timer slack to SLACK ticks.  A
+   thread that sleeps for N ticks becomes eligible to wake after
+   N ticks but may be held back up to SLACK more ticks, so that
+   its wakeup can be batched with those of other sleepers.  New
+   threads inherit their creator's slack. */
+void
+thread_set_timer_slack (int64_t slack)
+{
+  ASSERT (slack >= 0);
+  thread_current ()->timer_slack = slack;
+}
+
+/* Returns the current thread's timer slack, in ticks. */
+int64_t
+thread_get_timer_slack (void)
+{
+  return thread_current ()->timer_slack;
+}
+
 /* Invoke function 'func' on all threads, passing along 'aux'.
    This function must be called with interrupts off. */
 void
@@ -462,6 +487,18 @@ idle (void *idle_started_ UNUSED)
       intr_disable ();
       thread_block ();
 
+      /* Use the time to zero free pages for the pre-zeroed pool,
+         one page at a time, until some other thread becomes
+         ready or there is nothing left to do.  zpool_refill()
+         must be called with interrupts off and nothing ready,
+         which it also returns with, so the idle thread never
+         blocks on or is preempted inside the page allocator. */
+      while (list_empty (&ready_list))
+        if (!zpool_refill ())
+          break;
+      if (!list_empty (&ready_list))
+        continue;
+
       /* Re-enable interrupts and wait for the next one.
 
          The `sti' instruction disables interrupts until the
@@ -535,6 +572,8 @@ init_thread (struct thread *t, const char *name, int priority)
   t->priority = priority;
   t->magic = THREAD_MAGIC;
   t->wait_time = 0;
+  t->wait_slack = 0;
+  t->timer_slack = 0;
   t->donated = false;
 	if(thread_mlfqs)
 	{
@@ -549,6 +588,11 @@ init_thread (struct thread *t, const char *name, int priority)
   list_init (&t->donated_list);
   list_init (&t->lock_list);
   lock_init (&t->donated_lock);
+#ifdef USERPROG
+  list_init (&t->children);
+  lock_init (&t->page_lock);
+  list_init (&t->mappings);
+#endif
 }
 
 /* Allocates a SIZE-byte frame at the top of thread T's stack and
@@ -665,26 +709,45 @@ allocate_tid (void)
    Used by switch.S, which can't figure it out on its own. */
 uint32_t thread_stack_ofs = offsetof (struct thread, stack);
 
+/* Called once per tick.  A sleeper's window opens when its
+   wait_time reaches 0 and closes wait_slack ticks later.  No one
+   is woken until some sleeper's window closes; at that tick every
+   sleeper whose window is open is woken along with it, so that
+   overlapping wakeups cost a single tick. */
 void try_wakeup_sleepers (void)
 {
 	struct list_elem* head = list_head(&sleep_list);
 	struct list_elem* tail = list_tail(&sleep_list);
-	struct list_elem* cur = head->next;
+	struct list_elem* cur;
 	struct list_elem* temp;
 	struct thread* t;
+	bool expired = false;
 
-	while (cur != tail)
+	for (cur = head->next; cur != tail; cur = cur->next)
 	{
 		t = list_entry (cur,struct thread, elem);
 		if (t->wait_time != 0)
 			t->wait_time -= 1;
-		if (t->wait_time == 0)
-		{
-			temp = cur;
-		}
+		else if (t->wait_slack != 0)
+			t->wait_slack -= 1;
+		if (t->wait_time == 0 && t->wait_slack == 0)
+			expired = true;
+	}
+
+	if (!expired)
+		return;
+
+	cur = head->next;
+	while (cur != tail)
+	{
+		t = list_entry (cur,struct thread, elem);
+		temp = cur;
 		cur = cur->next;
 		if (t->wait_time == 0)
 		{
+			wakeup_cnt++;
+			if (t->wait_slack != 0)
+				coalesced_cnt++;
 			list_remove(temp);
 			new_push_thread (&ready_list, temp);
 		}
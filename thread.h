@@ -2,8 +2,10 @@
 #define THREADS_THREAD_H
 
 #include <debug.h>
+#include <hash.h>
 #include <list.h>
 #include <stdint.h>
+#include "threads/synch.h"
 
 /* States in a thread's life cycle. */
 enum thread_status
@@ -92,6 +94,8 @@ struct thread
     int priority;                       /* Priority. */
     struct list_elem allelem;           /* List element for all threads list. */
 	int64_t wait_time;                  /* time to wait */
+	int64_t wait_slack;                 /* ticks a wakeup may be deferred */
+	int64_t timer_slack;                /* slack applied to each sleep */
 	bool donated;
 	struct list donated_list;            /* values of before donated */
 	struct lock donated_lock;
@@ -103,6 +107,31 @@ struct thread
 #ifdef USERPROG
     /* Owned by userprog/process.c. */
     uint32_t *pagedir;                  /* Page directory. */
+    struct hash pages;                  /* Supplemental page table. */
+    struct file *exec_file;             /* Executable, open while running. */
+    struct exit_record *exit_record;    /* Shared with parent, or null. */
+    struct list children;               /* Children's `exit_record's. */
+
+    /* Owned by userprog/syscall.c. */
+    struct fd_table *fds;               /* Open files, or null if none yet. */
+
+    /* Owned by userprog/ioring.c. */
+    struct ioring *ioring;              /* Asynchronous I/O rings, or null. */
+
+    /* Owned by userprog/systrace.c. */
+    struct syscall_stats *syscall_stats; /* Statistics, or null. */
+    struct systrace *syscall_trace;     /* Trace, or null if not tracing. */
+
+    /* Owned by vm/mmap.c. */
+    struct list mappings;               /* Memory-mapped files. */
+    int next_mapid;                     /* Next mapping identifier. */
+
+    /* Owned by vm/page.c. */
+    void *ra_next;                      /* Page a sequential fault hits next. */
+    unsigned ra_pages;                  /* Current readahead window. */
+    struct lock page_lock;              /* Protects `pages' and mappings. */
+    size_t stack_limit;                 /* Most bytes the stack may span. */
+    void *user_esp;                     /* User esp at system call entry. */
 #endif
 
     /* Owned by thread.c. */
@@ -134,6 +163,9 @@ void thread_exit (void) NO_RETURN;
 void thread_yield (void);
 void thread_sleep_yield (int64_t);
 
+void thread_set_timer_slack (int64_t);
+int64_t thread_get_timer_slack (void);
+
 /* Performs some operation on thread t, given auxiliary data AUX. */
 typedef void thread_action_func (struct thread *t, void *aux);
 void thread_foreach (thread_action_func *, void *);
@@ -0,0 +1,130 @@
+#include "userprog/usercopy.h"
+#include <debug.h>
+#include <stdint.h>
+#include "threads/interrupt.h"
+#include "threads/vaddr.h"
+
+/* Copying to and from user memory.
+
+   The usual way for the kernel to touch user memory safely is
+   to check every page with pagedir_get_page() first, which costs
+   time proportional to the size of the buffer.  Instead, these
+   primitives only check that the range lies below PHYS_BASE,
+   which is O(1), and then simply access it.  If that access
+   faults on a page the process does not have, the page-fault
+   handler finds the faulting instruction in the exception table
+   and resumes at its fixup address instead of panicking, and the
+   primitive returns an error.
+
+   Each entry in the table pairs the address of an instruction
+   that may fault with the address to resume at.  The entries
+   are emitted into section `ex_table' next to the instructions
+   themselves.  The linker defines __start_ex_table and
+   __stop_ex_table around any section whose name is a valid C
+   identifier, so no linker script support is needed. */
+struct ex_entry
+  {
+    uintptr_t insn;             /* Instruction that may fault. */
+    uintptr_t fixup;            /* Where to resume if it does. */
+  };
+
+extern const struct ex_entry __start_ex_table[], __stop_ex_table[];
+
+/* Returns true if the SIZE bytes at UADDR lie entirely in user
+   space. */
+bool
+user_range_ok (const void *uaddr, size_t size)
+{
+  uintptr_t start = (uintptr_t) uaddr;
+  return start + size >= start && start + size <= (uintptr_t) PHYS_BASE;
+}
+
+/* Copies SIZE bytes from SRC to DST with `rep movsb', where one
+   of them is in user space.  Returns false if that faults. */
+static inline bool
+copy_bytes (void *dst, const void *src, size_t size)
+{
+  int error;
+
+  asm volatile ("movl $1, %0\n"
+                "1: rep movsb\n"
+                "xorl %0, %0\n"
+                "2:\n"
+                ".pushsection ex_table, \"a\"\n"
+                ".long 1b, 2b\n"
+                ".popsection"
+                : "=&a" (error), "+D" (dst), "+S" (src), "+c" (size)
+                : : "memory");
+  return error == 0;
+}
+
+/* Copies SIZE bytes from user address USRC to kernel address
+   DST.  Returns false if any part of the source is not user
+   memory the current process may read. */
+bool
+copy_from_user (void *dst, const void *usrc, size_t size)
+{
+  return user_range_ok (usrc, size) && copy_bytes (dst, usrc, size);
+}
+
+/* Copies SIZE bytes from kernel address SRC to user address
+   UDST.  Returns false if any part of the destination is not
+   user memory the current process may write. */
+bool
+copy_to_user (void *udst, const void *src, size_t size)
+{
+  return user_range_ok (udst, size) && copy_bytes (udst, src, size);
+}
+
+/* Copies the null-terminated string at user address USRC into
+   DST, which has room for SIZE bytes.  Returns the length of the
+   string, not counting the null terminator; or SIZE if the
+   string, with its null terminator, does not fit, in which case
+   DST is not null-terminated; or -1 if the string runs into
+   memory the current process may not read. */
+int
+strncpy_from_user (char *dst, const char *usrc, size_t size)
+{
+  size_t i;
+
+  for (i = 0; i < size; i++)
+    {
+      int error;
+      char c;
+
+      if (!user_range_ok (usrc + i, 1))
+        return -1;
+      asm volatile ("movl $1, %0\n"
+                    "1: movb %2, %1\n"
+                    "xorl %0, %0\n"
+                    "2:\n"
+                    ".pushsection ex_table, \"a\"\n"
+                    ".long 1b, 2b\n"
+                    ".popsection"
+                    : "=&a" (error), "=&q" (c) : "m" (usrc[i]));
+      if (error)
+        return -1;
+      dst[i] = c;
+      if (c == '\0')
+        return i;
+    }
+  return size;
+}
+
+/* Called by the page-fault handler for a fault in kernel mode
+   that it could not resolve.  If the faulting instruction is in
+   the exception table, redirects F to resume at its fixup
+   address and returns true.  Otherwise returns false. */
+bool
+usercopy_fixup (struct intr_frame *f)
+{
+  const struct ex_entry *e;
+
+  for (e = __start_ex_table; e < __stop_ex_table; e++)
+    if (e->insn == (uintptr_t) f->eip)
+      {
+        f->eip = (void (*) (void)) e->fixup;
+        return true;
+      }
+  return false;
+}
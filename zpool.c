@@ -0,0 +1,176 @@
+#include "threads/zpool.h"
+#include <debug.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/interrupt.h"
+#include "threads/vaddr.h"
+
+/* Pre-zeroed page pool.
+
+   Handing out zeroed pages costs a 4 kB memset, and that cost
+   lands on the critical path of thread creation and of every
+   zero-fill page fault.  Instead, the idle thread zeroes free
+   pages ahead of time and parks them here, and
+   zpool_get_page(PAL_ZERO) takes from here first.
+
+   There is one pool for kernel pages and one for user pages.
+   Each is a simple stack of page addresses: the pages themselves
+   must stay all zeroes, so they cannot hold any link.  Both are
+   manipulated with interrupts disabled rather than under a lock,
+   because the idle thread must never block. */
+struct zpool
+  {
+    enum palloc_flags flags;    /* PAL_USER or 0. */
+    size_t cnt;                 /* Number of pages in PAGES. */
+    void *pages[ZPOOL_MAX];     /* Zeroed pages. */
+  };
+
+static struct zpool kernel_zpool = { 0, 0, { NULL } };
+static struct zpool user_zpool = { PAL_USER, 0, { NULL } };
+
+/* Number of pages to keep in each pool. */
+static size_t zpool_size = 16;
+
+/* Statistics. */
+static long long hit_cnt;       /* # of PAL_ZERO pages from a pool. */
+static long long miss_cnt;      /* # of PAL_ZERO pages zeroed on demand. */
+
+static void *zpool_pop (struct zpool *);
+static void zpool_trim (struct zpool *);
+
+/* Sets the number of pre-zeroed pages kept in each pool to SIZE,
+   at most ZPOOL_MAX.  0 disables the pools.  Pages beyond the new
+   size are returned to the page allocator. */
+void
+zpool_set_size (size_t size)
+{
+  zpool_size = size < ZPOOL_MAX ? size : ZPOOL_MAX;
+  zpool_trim (&kernel_zpool);
+  zpool_trim (&user_zpool);
+}
+
+/* Obtains a free page, as palloc_get_page(), but for a PAL_ZERO
+   request takes an already-zeroed page from the matching pool if
+   there is one.  A request without PAL_ZERO may also be satisfied
+   from the pool once the page allocator itself has run dry, so
+   that pages parked here are never lost to the rest of the
+   system. */
+void *
+zpool_get_page (enum palloc_flags flags)
+{
+  struct zpool *z = flags & PAL_USER ? &user_zpool : &kernel_zpool;
+  void *page;
+
+  if (flags & PAL_ZERO)
+    {
+      page = zpool_pop (z);
+      if (page != NULL)
+        {
+          hit_cnt++;
+          return page;
+        }
+      miss_cnt++;
+      return palloc_get_page (flags);
+    }
+
+  page = palloc_get_page (flags & ~PAL_ASSERT);
+  if (page == NULL)
+    page = zpool_pop (z);
+  if (page == NULL && (flags & PAL_ASSERT))
+    PANIC ("zpool_get_page: out of pages");
+  return page;
+}
+
+/* Zeroes one free page and adds it to whichever pool is short,
+   the kernel pool first.  Called by the idle thread one page at a
+   time, so that it can stop as soon as another thread becomes
+   ready.  Returns false if both pools are full or no free page
+   could be had.
+
+   Must be called with interrupts off and no other thread ready
+   to run.  Then every other thread is blocked, and palloc never
+   blocks while holding its pool lock, so the lock is free and
+   taking it cannot block the idle thread.  Interrupts stay off
+   until the page has been allocated, so the idle thread is never
+   preempted while holding the lock either; if it were, a thread
+   waiting on the lock would donate its priority to the idle
+   thread in vain, since the idle thread only runs when nothing
+   else can.  They are turned on only to zero the page.  Returns
+   with interrupts off again. */
+bool
+zpool_refill (void)
+{
+  struct zpool *pools[] = { &kernel_zpool, &user_zpool };
+  size_t i;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  for (i = 0; i < sizeof pools / sizeof *pools; i++)
+    {
+      struct zpool *z = pools[i];
+      void *page;
+
+      if (z->cnt >= zpool_size)
+        continue;
+      page = palloc_get_page (z->flags);
+      if (page == NULL)
+        continue;
+
+      intr_enable ();
+      memset (page, 0, PGSIZE);
+      intr_disable ();
+
+      /* Only this function adds pages, so there is still room,
+         although zpool_set_size() may have shrunk the pool in
+         the meantime.  Then the pool holds one page too many
+         until someone takes it, which is harmless, and better
+         than freeing it here, where the page allocator's lock
+         might now be held. */
+      ASSERT (z->cnt < ZPOOL_MAX);
+      z->pages[z->cnt++] = page;
+      return true;
+    }
+  return false;
+}
+
+/* Prints pre-zeroed page pool statistics. */
+void
+zpool_print_stats (void)
+{
+  printf ("Zero pool: %lld hits, %lld misses\n", hit_cnt, miss_cnt);
+}
+
+/* Removes and returns a page from Z, or returns a null pointer
+   if Z is empty. */
+static void *
+zpool_pop (struct zpool *z)
+{
+  enum intr_level old_level;
+  void *page = NULL;
+
+  old_level = intr_disable ();
+  if (z->cnt > 0)
+    page = z->pages[--z->cnt];
+  intr_set_level (old_level);
+  return page;
+}
+
+/* Frees the pages in Z beyond the current pool size. */
+static void
+zpool_trim (struct zpool *z)
+{
+  for (;;)
+    {
+      enum intr_level old_level;
+      void *page = NULL;
+
+      old_level = intr_disable ();
+      if (z->cnt > zpool_size)
+        page = z->pages[--z->cnt];
+      intr_set_level (old_level);
+
+      if (page == NULL)
+        break;
+      palloc_free_page (page);
+    }
+}
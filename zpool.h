@@ -0,0 +1,17 @@
+#ifndef THREADS_ZPOOL_H
+#define THREADS_ZPOOL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "threads/palloc.h"
+
+/* Most pages kept pre-zeroed in each of the kernel and user
+   pools. */
+#define ZPOOL_MAX 64
+
+void zpool_set_size (size_t);
+void *zpool_get_page (enum palloc_flags);
+bool zpool_refill (void);
+void zpool_print_stats (void);
+
+#endif /* threads/zpool.h */